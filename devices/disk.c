@@ -85,6 +85,7 @@ static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
 static void select_sector (struct disk *, disk_sector_t);
+static void select_sectors (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -250,6 +251,87 @@ disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
 	lock_release (&c->lock);
 }
 
+/* Most sectors one READ SECTOR or WRITE SECTOR command can move. */
+#define MAX_SECTORS_PER_CMD 256
+
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  Unlike calling disk_read() CNT times, this issues one
+   command per MAX_SECTORS_PER_CMD sectors.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, void *buffer,
+		size_t cnt) {
+	struct channel *c;
+	uint8_t *p = buffer;
+
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+
+	c = d->channel;
+	lock_acquire (&c->lock);
+	while (cnt > 0) {
+		size_t chunk = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+		size_t i;
+
+		select_sectors (d, sec_no, chunk);
+		issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+		/* The device interrupts once per sector, when its data is
+		   ready. */
+		for (i = 0; i < chunk; i++) {
+			sema_down (&c->completion_wait);
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+						sec_no + (disk_sector_t) i);
+			input_sector (c, p);
+			p += DISK_SECTOR_SIZE;
+		}
+		d->read_cnt += chunk;
+		sec_no += chunk;
+		cnt -= chunk;
+	}
+	lock_release (&c->lock);
+}
+
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D from
+   BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no,
+		const void *buffer, size_t cnt) {
+	struct channel *c;
+	const uint8_t *p = buffer;
+
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+
+	c = d->channel;
+	lock_acquire (&c->lock);
+	while (cnt > 0) {
+		size_t chunk = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+		size_t i;
+
+		select_sectors (d, sec_no, chunk);
+		issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+		/* The device interrupts once per sector, after taking it. */
+		for (i = 0; i < chunk; i++) {
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+						sec_no + (disk_sector_t) i);
+			output_sector (c, p);
+			p += DISK_SECTOR_SIZE;
+			sema_down (&c->completion_wait);
+		}
+		d->write_cnt += chunk;
+		sec_no += chunk;
+		cnt -= chunk;
+	}
+	lock_release (&c->lock);
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -406,13 +488,24 @@ print_ata_string (char *string, size_t size) {
    use LBA mode.) */
 static void
 select_sector (struct disk *d, disk_sector_t sec_no) {
+	select_sectors (d, sec_no, 1);
+}
+
+/* Selects device D, waiting for it to become ready, and then
+   writes SEC_NO and CNT, which must be between 1 and
+   MAX_SECTORS_PER_CMD, to the disk's sector selection
+   registers. */
+static void
+select_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt >= 1 && cnt <= MAX_SECTORS_PER_CMD);
+	ASSERT (sec_no + cnt <= d->capacity);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	/* A count of 0 means 256. */
+	outb (reg_nsect (c), cnt & 0xff);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
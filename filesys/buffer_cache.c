@@ -0,0 +1,588 @@
+/* buffer_cache.c: Cache of file system sectors.
+ *
+ * Every sector of filesys_disk that the file system reads or writes,
+ * whether it holds file data, an inode, a directory, the free map or the
+ * FAT, goes through this cache of BUFFER_CACHE_SIZE sectors.  Sectors
+ * are found through a hash table keyed by sector number.
+ *
+ * Sectors are replaced by ARC (Megiddo and Modha, "ARC: A Self-Tuning,
+ * Low Overhead Replacement Cache", FAST 2003).  Cached sectors are kept
+ * in two LRU lists: T1 for sectors used once lately and T2 for those
+ * used again.  B1 and B2 remember the numbers of sectors recently
+ * replaced from T1 and T2, as ghosts.  Missing a sector that has a
+ * ghost in B1 means T1 was too small, and moves the target size of T1
+ * up; a ghost in B2 moves it down.  Replacement takes from T1 while it
+ * is over target.  A scan that reads many sectors once thus only cycles
+ * through T1 and cannot push the sectors in T2 out.
+ *
+ * One read of a whole file in small pieces uses each sector several
+ * times in a row.  Such uses, within CORRELATED_PERIOD of the first,
+ * count as one, as in 2Q, or every scan would end up in T2.
+ *
+ * Writes only dirty the cached copy.  A write that covers a whole
+ * sector does not read it first.  A flusher thread wakes up every
+ * FLUSH_INTERVAL and writes back sectors that have been dirty for
+ * DIRTY_EXPIRE, gathering dirty neighbours on disk into one command of
+ * up to FLUSH_RUN_MAX sectors; buffer_cache_flush() writes back all of
+ * them, at shutdown.  A dirty sector that is evicted is written on the
+ * spot.
+ *
+ * buffer_cache_prefetch() reads sectors in ahead of their use, for the
+ * readahead in page_cache.c, with one command per run of missing
+ * sectors.
+ *
+ * Disk I/O is done without cache_lock.  An entry being read in or
+ * evicted is marked busy and anyone who wants it waits on cache_io.
+ * The flusher copies its runs out first, so that the entries stay
+ * usable while they are written; it only keeps them from being
+ * evicted, so that nobody reads a sector from disk before its newer
+ * contents get there. */
+
+#include "filesys/buffer_cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors cached. */
+#define BUFFER_CACHE_SIZE 64
+
+/* Most sectors written by one command of the flusher. */
+#define FLUSH_RUN_MAX (PGSIZE / DISK_SECTOR_SIZE)
+
+/* How often the flusher wakes up, and how long a sector may stay dirty
+ * before it writes it back, as Linux does by default. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+#define DIRTY_EXPIRE (30 * TIMER_FREQ)
+
+/* Uses of a sector in T1 that follow its first one this closely are
+ * taken to be part of it. */
+#define CORRELATED_PERIOD (TIMER_FREQ / 20)
+
+/* One of the ARC lists, most recently used first. */
+struct arc_list {
+	struct list list;
+	size_t size;
+};
+
+/* A cached sector. */
+struct cache_entry {
+	struct hash_elem elem;      /* Element in cache_index, if in a list. */
+	struct list_elem lru_elem;  /* Element in LRU or in free_entries. */
+	struct arc_list *lru;       /* T1 or T2, or null if free. */
+	disk_sector_t sector;       /* Sector held. */
+	uint8_t *data;              /* DISK_SECTOR_SIZE bytes. */
+	bool busy;                  /* Being read in or written back. */
+	bool dirty;                 /* Newer than the disk? */
+	bool prefetched;            /* Read ahead and not used yet? */
+	int flush_cnt;              /* Runs of the flusher it is in. */
+	int64_t used;               /* timer_ticks() at its first use in T1. */
+	int64_t dirty_since;        /* timer_ticks() when it became dirty. */
+};
+
+/* The number of a sector replaced lately. */
+struct ghost {
+	struct hash_elem elem;      /* Element in ghost_index, if in a list. */
+	struct list_elem lru_elem;  /* Element in LRU or in free_ghosts. */
+	struct arc_list *lru;       /* B1 or B2. */
+	disk_sector_t sector;
+};
+
+static struct cache_entry cache[BUFFER_CACHE_SIZE];
+static struct hash cache_index;         /* Entries in T1 and T2, by sector. */
+static struct list free_entries;        /* Entries holding no sector. */
+static struct ghost ghosts[BUFFER_CACHE_SIZE];
+static struct hash ghost_index;         /* Ghosts in B1 and B2, by sector. */
+static struct list free_ghosts;         /* Ghosts in neither. */
+static struct arc_list t1, t2, b1, b2;
+static size_t t1_target;                /* Target size of T1. */
+static struct lock cache_lock;          /* Protects all of the above. */
+static struct condition cache_io;       /* An entry is no longer busy. */
+
+/* Serializes flushes, which share FLUSH_BUFFER. */
+static struct lock flush_lock;
+static uint8_t *flush_buffer;           /* FLUSH_RUN_MAX sectors. */
+
+/* Serializes prefetches, which share PREFETCH_BUFFER. */
+static struct lock prefetch_lock;
+static uint8_t *prefetch_buffer;        /* FLUSH_RUN_MAX sectors. */
+
+static long long hit_cnt;       /* Lookups that found the sector. */
+static long long miss_cnt;      /* Lookups that had to replace one. */
+static long long flush_cnt;     /* Sectors written back by flushes. */
+static long long evict_cnt;     /* Dirty sectors written on eviction. */
+static long long prefetch_cnt;  /* Sectors read ahead. */
+static long long ghost_cnt;     /* Misses that found a ghost. */
+
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+static hash_hash_func ghost_hash;
+static hash_less_func ghost_less;
+static void flusher (void *aux);
+
+/* Initializes the buffer cache and starts the flusher. */
+void
+buffer_cache_init (void) {
+	uint8_t *data = palloc_get_multiple (PAL_ASSERT,
+			BUFFER_CACHE_SIZE * DISK_SECTOR_SIZE / PGSIZE);
+	size_t i;
+
+	list_init (&free_entries);
+	list_init (&free_ghosts);
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		cache[i].data = data + i * DISK_SECTOR_SIZE;
+		list_push_back (&free_entries, &cache[i].lru_elem);
+		list_push_back (&free_ghosts, &ghosts[i].lru_elem);
+	}
+	list_init (&t1.list);
+	list_init (&t2.list);
+	list_init (&b1.list);
+	list_init (&b2.list);
+	if (!hash_init (&cache_index, entry_hash, entry_less, NULL)
+			|| !hash_init (&ghost_index, ghost_hash, ghost_less, NULL))
+		PANIC ("buffer_cache_init: cannot allocate hash table");
+	lock_init (&cache_lock);
+	cond_init (&cache_io);
+	lock_init (&flush_lock);
+	flush_buffer = palloc_get_page (PAL_ASSERT);
+	lock_init (&prefetch_lock);
+	prefetch_buffer = palloc_get_page (PAL_ASSERT);
+	if (thread_create ("flusher", PRI_DEFAULT, flusher, NULL) == TID_ERROR)
+		PANIC ("buffer_cache_init: cannot start flusher");
+}
+
+/* Prints buffer cache statistics. */
+void
+buffer_cache_print_stats (void) {
+	printf ("Buffer cache: %lld hits, %lld misses (%lld ghosts), %lld "
+			"sectors written behind, %lld on eviction, %lld read ahead\n",
+			hit_cnt, miss_cnt, ghost_cnt, flush_cnt, evict_cnt, prefetch_cnt);
+}
+
+/* Returns the hash of entry E, its sector. */
+static uint64_t
+entry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	disk_sector_t sector = hash_entry (e, struct cache_entry, elem)->sector;
+	return hash_bytes (&sector, sizeof sector);
+}
+
+/* Orders entries A and B by sector. */
+static bool
+entry_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct cache_entry, elem)->sector
+		< hash_entry (b, struct cache_entry, elem)->sector;
+}
+
+/* Returns the hash of ghost E, its sector. */
+static uint64_t
+ghost_hash (const struct hash_elem *e, void *aux UNUSED) {
+	disk_sector_t sector = hash_entry (e, struct ghost, elem)->sector;
+	return hash_bytes (&sector, sizeof sector);
+}
+
+/* Orders ghosts A and B by sector. */
+static bool
+ghost_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct ghost, elem)->sector
+		< hash_entry (b, struct ghost, elem)->sector;
+}
+
+/* Adds ELEM at the front of LRU. */
+static void
+arc_push (struct arc_list *lru, struct list_elem *elem) {
+	list_push_front (&lru->list, elem);
+	lru->size++;
+}
+
+/* Removes ELEM from LRU. */
+static void
+arc_remove (struct arc_list *lru, struct list_elem *elem) {
+	list_remove (elem);
+	lru->size--;
+}
+
+/* Returns the ghost of SECTOR, or a null pointer. */
+static struct ghost *
+ghost_find (disk_sector_t sector) {
+	struct ghost key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&ghost_index, &key.elem);
+	return e != NULL ? hash_entry (e, struct ghost, elem) : NULL;
+}
+
+/* Forgets ghost G. */
+static void
+ghost_drop (struct ghost *g) {
+	arc_remove (g->lru, &g->lru_elem);
+	hash_delete (&ghost_index, &g->elem);
+	list_push_back (&free_ghosts, &g->lru_elem);
+}
+
+/* Forgets the least recently replaced ghost in LRU, if any. */
+static void
+ghost_drop_lru (struct arc_list *lru) {
+	if (lru->size > 0)
+		ghost_drop (list_entry (list_back (&lru->list), struct ghost,
+					lru_elem));
+}
+
+/* Remembers SECTOR, just replaced, in LRU. */
+static void
+ghost_add (disk_sector_t sector, struct arc_list *lru) {
+	struct ghost *g;
+
+	if (list_empty (&free_ghosts))
+		ghost_drop_lru (b2.size > 0 ? &b2 : &b1);
+	g = list_entry (list_pop_front (&free_ghosts), struct ghost, lru_elem);
+	g->sector = sector;
+	g->lru = lru;
+	arc_push (lru, &g->lru_elem);
+	hash_insert (&ghost_index, &g->elem);
+}
+
+/* Returns the target size of T1 after a miss that found ghost G, which
+ * may be null. */
+static size_t
+arc_target (const struct ghost *g) {
+	size_t delta;
+
+	if (g == NULL)
+		return t1_target;
+	if (g->lru == &b1) {
+		delta = b2.size > b1.size ? b2.size / b1.size : 1;
+		return t1_target + delta < BUFFER_CACHE_SIZE
+			? t1_target + delta : BUFFER_CACHE_SIZE;
+	}
+	delta = b1.size > b2.size ? b1.size / b2.size : 1;
+	return t1_target > delta ? t1_target - delta : 0;
+}
+
+/* Returns the entry holding SECTOR, or a null pointer. */
+static struct cache_entry *
+cache_find (disk_sector_t sector) {
+	struct cache_entry key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&cache_index, &key.elem);
+	return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/* Marks entry E busy and runs the disk command DO_WRITE says on it
+ * without cache_lock. */
+static void
+cache_io_entry (struct cache_entry *e, bool do_write) {
+	e->busy = true;
+	lock_release (&cache_lock);
+	if (do_write)
+		disk_write (filesys_disk, e->sector, e->data);
+	else
+		disk_read (filesys_disk, e->sector, e->data);
+	lock_acquire (&cache_lock);
+	e->busy = false;
+	cond_broadcast (&cache_io, &cache_lock);
+}
+
+/* Returns the least recently used entry in LRU that may be replaced,
+ * or a null pointer if there is none. */
+static struct cache_entry *
+lru_victim (struct arc_list *lru) {
+	struct list_elem *e;
+
+	for (e = list_rbegin (&lru->list); e != list_rend (&lru->list);
+			e = list_prev (e)) {
+		struct cache_entry *entry = list_entry (e, struct cache_entry,
+				lru_elem);
+
+		if (!entry->busy && entry->flush_cnt == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+/* Returns the entry to replace for a miss on SECTOR, or a null pointer
+ * if there is none right now.  DEMAND is false for readahead, which
+ * does not adapt the target size of T1. */
+static struct cache_entry *
+cache_victim (disk_sector_t sector, bool demand) {
+	struct ghost *g = demand ? ghost_find (sector) : NULL;
+	size_t target = arc_target (g);
+	struct arc_list *first = &t2, *second = &t1;
+	struct cache_entry *e;
+
+	if (!list_empty (&free_entries))
+		return list_entry (list_front (&free_entries), struct cache_entry,
+				lru_elem);
+	if (t1.size > 0 && (t1.size > target
+				|| (g != NULL && g->lru == &b2 && t1.size == target))) {
+		first = &t1;
+		second = &t2;
+	}
+	e = lru_victim (first);
+	return e != NULL ? e : lru_victim (second);
+}
+
+/* Makes entry E, a clean one returned by cache_victim() for the same
+ * SECTOR and DEMAND, hold SECTOR, and updates the ARC lists. */
+static void
+cache_install (struct cache_entry *e, disk_sector_t sector, bool demand) {
+	struct ghost *g = ghost_find (sector);
+	bool remember = true;
+
+	if (demand)
+		t1_target = arc_target (g);
+	if (g != NULL) {
+		if (demand)
+			ghost_cnt++;
+		ghost_drop (g);
+	} else if (t1.size + b1.size >= BUFFER_CACHE_SIZE) {
+		/* Keep T1 and B1 to the size of the cache. */
+		if (b1.size > 0)
+			ghost_drop_lru (&b1);
+		else
+			remember = false;
+	} else if (t1.size + t2.size + b1.size + b2.size
+			>= 2 * BUFFER_CACHE_SIZE)
+		ghost_drop_lru (&b2);
+
+	if (e->lru == NULL)
+		list_remove (&e->lru_elem);
+	else {
+		struct arc_list *lru = e->lru;
+
+		arc_remove (lru, &e->lru_elem);
+		hash_delete (&cache_index, &e->elem);
+		if (remember || lru != &t1)
+			ghost_add (e->sector, lru == &t1 ? &b1 : &b2);
+	}
+
+	e->sector = sector;
+	e->lru = demand && g != NULL ? &t2 : &t1;
+	e->prefetched = !demand;
+	e->used = timer_ticks ();
+	arc_push (e->lru, &e->lru_elem);
+	hash_insert (&cache_index, &e->elem);
+}
+
+/* Records a use of entry E, which holds the sector looked up. */
+static void
+cache_touch (struct cache_entry *e) {
+	int64_t now = timer_ticks ();
+	struct arc_list *lru = &t2;
+
+	if (e->lru == &t1
+			&& (e->prefetched || now - e->used < CORRELATED_PERIOD)) {
+		/* Still its first use. */
+		lru = &t1;
+		if (e->prefetched) {
+			e->prefetched = false;
+			e->used = now;
+		}
+	}
+	arc_remove (e->lru, &e->lru_elem);
+	e->lru = lru;
+	arc_push (lru, &e->lru_elem);
+}
+
+/* Returns the entry holding SECTOR, replacing another one if need be,
+ * with its contents read in unless LOAD is false.  The entry is not
+ * busy.  Must hold cache_lock, which may be released meanwhile. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool load) {
+	for (;;) {
+		struct cache_entry *e = cache_find (sector);
+
+		if (e != NULL) {
+			if (e->busy) {
+				cond_wait (&cache_io, &cache_lock);
+				continue;
+			}
+			hit_cnt++;
+			cache_touch (e);
+			return e;
+		}
+
+		e = cache_victim (sector, true);
+		if (e == NULL) {
+			cond_wait (&cache_io, &cache_lock);
+			continue;
+		}
+		if (e->dirty) {
+			/* Someone may bring SECTOR in meanwhile, so look again
+			 * afterwards. */
+			e->dirty = false;
+			evict_cnt++;
+			cache_io_entry (e, true);
+			continue;
+		}
+
+		miss_cnt++;
+		cache_install (e, sector, true);
+		if (load)
+			cache_io_entry (e, false);
+		return e;
+	}
+}
+
+/* Copies SIZE bytes at offset OFS of SECTOR into BUFFER. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer, int ofs, int size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	e = cache_get (sector, true);
+	memcpy (buffer, e->data + ofs, size);
+	lock_release (&cache_lock);
+}
+
+/* Copies SIZE bytes from BUFFER to offset OFS of SECTOR. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer, int ofs,
+		int size) {
+	struct cache_entry *e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	e = cache_get (sector, ofs > 0 || size < DISK_SECTOR_SIZE);
+	memcpy (e->data + ofs, buffer, size);
+	if (!e->dirty) {
+		e->dirty = true;
+		e->dirty_since = timer_ticks ();
+	}
+	lock_release (&cache_lock);
+}
+
+/* Reads the CNT sectors from SECTOR into the cache, those that are not
+ * there yet, without waiting for any other I/O: a sector that could
+ * only get an entry by writing back a dirty one is skipped.  Sectors
+ * read in this way go to T1, and their first use keeps them there. */
+void
+buffer_cache_prefetch (disk_sector_t sector, size_t cnt) {
+	struct cache_entry *run[FLUSH_RUN_MAX];
+
+	lock_acquire (&prefetch_lock);
+	lock_acquire (&cache_lock);
+	while (cnt > 0) {
+		size_t n = 0, i;
+
+		/* Claim entries for the missing sectors from SECTOR on. */
+		while (n < cnt && n < FLUSH_RUN_MAX
+				&& cache_find (sector + n) == NULL) {
+			struct cache_entry *e = cache_victim (sector + n, false);
+
+			if (e == NULL || e->dirty)
+				break;
+			cache_install (e, sector + n, false);
+			e->busy = true;
+			run[n++] = e;
+		}
+		if (n == 0) {
+			sector++;
+			cnt--;
+			continue;
+		}
+
+		lock_release (&cache_lock);
+		disk_read_multiple (filesys_disk, sector, prefetch_buffer, n);
+		lock_acquire (&cache_lock);
+
+		for (i = 0; i < n; i++) {
+			memcpy (run[i]->data, prefetch_buffer + i * DISK_SECTOR_SIZE,
+					DISK_SECTOR_SIZE);
+			run[i]->busy = false;
+		}
+		cond_broadcast (&cache_io, &cache_lock);
+		prefetch_cnt += n;
+		sector += n;
+		cnt -= n;
+	}
+	lock_release (&cache_lock);
+	lock_release (&prefetch_lock);
+}
+
+/* Returns true if entry E may be written back by a flush. */
+static bool
+entry_is_flushable (const struct cache_entry *e) {
+	return e != NULL && e->lru != NULL && e->dirty && !e->busy;
+}
+
+/* Writes back the run of dirty sectors on disk around entry E, up to
+ * FLUSH_RUN_MAX of them, in one command.  Must hold flush_lock and
+ * cache_lock, which is released meanwhile. */
+static void
+flush_run (struct cache_entry *e) {
+	struct cache_entry *run[FLUSH_RUN_MAX];
+	disk_sector_t start = e->sector;
+	size_t cnt, i;
+
+	while (start > 0 && e->sector - (start - 1) < FLUSH_RUN_MAX
+			&& entry_is_flushable (cache_find (start - 1)))
+		start--;
+	for (cnt = 0; cnt < FLUSH_RUN_MAX; cnt++) {
+		struct cache_entry *next = cache_find (start + cnt);
+
+		if (!entry_is_flushable (next))
+			break;
+		run[cnt] = next;
+		memcpy (flush_buffer + cnt * DISK_SECTOR_SIZE, next->data,
+				DISK_SECTOR_SIZE);
+		next->dirty = false;
+		next->flush_cnt++;
+	}
+
+	lock_release (&cache_lock);
+	disk_write_multiple (filesys_disk, start, flush_buffer, cnt);
+	lock_acquire (&cache_lock);
+
+	for (i = 0; i < cnt; i++)
+		run[i]->flush_cnt--;
+	flush_cnt += cnt;
+	cond_broadcast (&cache_io, &cache_lock);
+}
+
+/* Writes back dirty sectors, only those that expired unless ALL. */
+static void
+cache_flush (bool all) {
+	int64_t now = timer_ticks ();
+	size_t i;
+
+	lock_acquire (&flush_lock);
+	lock_acquire (&cache_lock);
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		struct cache_entry *e = &cache[i];
+
+		if (entry_is_flushable (e)
+				&& (all || now - e->dirty_since >= DIRTY_EXPIRE))
+			flush_run (e);
+	}
+	lock_release (&cache_lock);
+	lock_release (&flush_lock);
+}
+
+/* Writes every dirty sector back to disk. */
+void
+buffer_cache_flush (void) {
+	cache_flush (true);
+}
+
+/* The flusher.  Writes back expired sectors every FLUSH_INTERVAL. */
+static void
+flusher (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (FLUSH_INTERVAL);
+		cache_flush (false);
+	}
+}
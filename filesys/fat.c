@@ -1,8 +1,10 @@
 #include "filesys/fat.h"
 #include "devices/disk.h"
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
+#include "threads/vmalloc.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -28,6 +30,17 @@ struct fat_fs {
 
 static struct fat_fs *fat_fs;
 
+/* LEN clusters of a chain, from its OFSth on, that follow each other on
+ * disk. */
+struct fat_run {
+	size_t ofs;
+	cluster_t clst;
+	size_t len;
+};
+
+/* Maps in use, protected by fat_fs->write_lock. */
+static struct list fat_maps;
+
 void fat_boot_create (void);
 void fat_fs_init (void);
 
@@ -36,14 +49,10 @@ fat_init (void) {
 	fat_fs = calloc (1, sizeof (struct fat_fs));
 	if (fat_fs == NULL)
 		PANIC ("FAT init failed");
+	list_init (&fat_maps);
 
 	// Read boot sector from the disk
-	unsigned int *bounce = malloc (DISK_SECTOR_SIZE);
-	if (bounce == NULL)
-		PANIC ("FAT init failed");
-	disk_read (filesys_disk, FAT_BOOT_SECTOR, bounce);
-	memcpy (&fat_fs->bs, bounce, sizeof (fat_fs->bs));
-	free (bounce);
+	buffer_cache_read (FAT_BOOT_SECTOR, &fat_fs->bs, 0, sizeof (fat_fs->bs));
 
 	// Extract FAT info
 	if (fat_fs->bs.magic != FAT_MAGIC)
@@ -51,32 +60,36 @@ fat_init (void) {
 	fat_fs_init ();
 }
 
+/* Allocates the in-memory FAT.  It is one entry per cluster and
+ * easily spans many pages, so it lives in vmalloc() memory. */
+static cluster_t *
+fat_alloc_table (void) {
+	size_t size = fat_fs->fat_length * sizeof (cluster_t);
+	cluster_t *fat = vmalloc (size);
+	if (fat != NULL)
+		memset (fat, 0, size);
+	return fat;
+}
+
 void
 fat_open (void) {
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
+	vfree (fat_fs->fat);
+	fat_fs->fat = fat_alloc_table ();
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT load failed");
 
-	// Load FAT directly from the disk
+	// Load FAT from the disk
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
 	off_t bytes_read = 0;
 	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
-		}
+		if (bytes_left > DISK_SECTOR_SIZE)
+			bytes_left = DISK_SECTOR_SIZE;
+		buffer_cache_read (fat_fs->bs.fat_start + i, buffer + bytes_read, 0,
+		                   bytes_left);
+		bytes_read += bytes_left;
 	}
 }
 
@@ -87,10 +100,10 @@ fat_close (void) {
 	if (bounce == NULL)
 		PANIC ("FAT close failed");
 	memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
-	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
+	buffer_cache_write (FAT_BOOT_SECTOR, bounce, 0, DISK_SECTOR_SIZE);
 	free (bounce);
 
-	// Write FAT directly to the disk
+	// Write FAT to the disk
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
 	off_t bytes_wrote = 0;
 	off_t bytes_left = sizeof (fat_fs->fat);
@@ -98,15 +111,16 @@ fat_close (void) {
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_wrote;
 		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
+			buffer_cache_write (fat_fs->bs.fat_start + i,
+			                    buffer + bytes_wrote, 0, DISK_SECTOR_SIZE);
 			bytes_wrote += DISK_SECTOR_SIZE;
 		} else {
 			bounce = calloc (1, DISK_SECTOR_SIZE);
 			if (bounce == NULL)
 				PANIC ("FAT close failed");
 			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
+			buffer_cache_write (fat_fs->bs.fat_start + i, bounce, 0,
+			                    DISK_SECTOR_SIZE);
 			bytes_wrote += bytes_left;
 			free (bounce);
 		}
@@ -120,7 +134,7 @@ fat_create (void) {
 	fat_fs_init ();
 
 	// Create FAT table
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
+	fat_fs->fat = fat_alloc_table ();
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT creation failed");
 
@@ -131,7 +145,8 @@ fat_create (void) {
 	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
 	if (buf == NULL)
 		PANIC ("FAT create failed due to OOM");
-	disk_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
+	buffer_cache_write (cluster_to_sector (ROOT_DIR_CLUSTER), buf, 0,
+	                    DISK_SECTOR_SIZE);
 	free (buf);
 }
 
@@ -152,42 +167,236 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	/* Cluster 0 means no cluster, so entry 0 is not used. */
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+	                     / SECTORS_PER_CLUSTER + 1;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER;
+	lock_init (&fat_fs->write_lock);
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Adds a run for cluster CLST, the OFSth of its chain, to MAP.  Returns
+ * false if out of memory. */
+static bool
+fat_map_push (struct fat_map *map, size_t ofs, cluster_t clst) {
+	struct fat_run *run;
+
+	if (map->run_cnt > 0) {
+		run = &map->runs[map->run_cnt - 1];
+		if (run->clst + run->len == clst) {
+			run->len++;
+			return true;
+		}
+	}
+	if (map->run_cnt == map->run_cap) {
+		size_t cap = map->run_cap > 0 ? map->run_cap * 2 : 4;
+		struct fat_run *runs = realloc (map->runs, cap * sizeof *runs);
+
+		if (runs == NULL)
+			return false;
+		map->runs = runs;
+		map->run_cap = cap;
+	}
+	run = &map->runs[map->run_cnt++];
+	run->ofs = ofs;
+	run->clst = clst;
+	run->len = 1;
+	return true;
+}
+
+/* Walks MAP's chain to fill in its runs.  Must hold the write lock. */
+static void
+fat_map_build (struct fat_map *map) {
+	cluster_t clst = map->start;
+	size_t ofs = 0;
+
+	map->run_cnt = 0;
+	map->valid = true;
+	for (; clst != 0 && clst != EOChain; clst = fat_get (clst))
+		if (!fat_map_push (map, ofs++, clst)) {
+			map->valid = false;
+			break;
+		}
+}
+
+/* Returns true if cluster CLST is in a run of MAP. */
+static bool
+fat_map_contains (const struct fat_map *map, cluster_t clst) {
+	size_t i;
+
+	for (i = 0; i < map->run_cnt; i++)
+		if (clst >= map->runs[i].clst
+				&& clst < map->runs[i].clst + map->runs[i].len)
+			return true;
+	return false;
+}
+
+/* Sets up MAP for the chain that starts with cluster START, 0 for an
+ * empty chain.  Its runs are found on first use. */
+void
+fat_map_init (struct fat_map *map, cluster_t start) {
+	map->start = start;
+	map->valid = false;
+	map->run_cnt = map->run_cap = 0;
+	map->runs = NULL;
+	lock_acquire (&fat_fs->write_lock);
+	list_push_back (&fat_maps, &map->elem);
+	lock_release (&fat_fs->write_lock);
+}
+
+/* Frees the runs of MAP. */
+void
+fat_map_destroy (struct fat_map *map) {
+	lock_acquire (&fat_fs->write_lock);
+	list_remove (&map->elem);
+	lock_release (&fat_fs->write_lock);
+	free (map->runs);
+}
+
+/* Returns the IDXth cluster of MAP's chain, counting from 0, or 0 if
+ * the chain is not that long.  If CNT is not null, stores in *CNT how
+ * many clusters of the chain, from that one on, follow each other on
+ * disk. */
+cluster_t
+fat_map_lookup (struct fat_map *map, size_t idx, size_t *cnt) {
+	cluster_t clst = 0;
+	size_t run_left = 0;
+	size_t lo = 0, hi;
+
+	lock_acquire (&fat_fs->write_lock);
+	if (!map->valid)
+		fat_map_build (map);
+	if (map->valid) {
+		hi = map->run_cnt;
+		while (hi - lo > 1) {
+			size_t mid = lo + (hi - lo) / 2;
+
+			if (map->runs[mid].ofs <= idx)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		if (map->run_cnt > 0 && idx - map->runs[lo].ofs < map->runs[lo].len) {
+			clst = map->runs[lo].clst + (idx - map->runs[lo].ofs);
+			run_left = map->runs[lo].len - (idx - map->runs[lo].ofs);
+		}
+	} else {
+		/* Out of memory: walk the chain. */
+		for (clst = map->start; clst != 0 && clst != EOChain && idx > 0;
+				idx--)
+			clst = fat_get (clst);
+		if (clst == EOChain)
+			clst = 0;
+		run_left = clst != 0;
+	}
+	lock_release (&fat_fs->write_lock);
+	if (cnt != NULL)
+		*cnt = run_left;
+	return clst;
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	cluster_t new = 0;
+	cluster_t i;
+	struct list_elem *e;
+
+	lock_acquire (&fat_fs->write_lock);
+	/* Next fit, from the last cluster handed out. */
+	for (i = 0; i < fat_fs->fat_length - 1; i++) {
+		cluster_t c = (fat_fs->last_clst + i) % (fat_fs->fat_length - 1) + 1;
+
+		if (fat_fs->fat[c] == 0) {
+			new = c;
+			break;
+		}
+	}
+	if (new != 0) {
+		fat_fs->fat[new] = EOChain;
+		fat_fs->last_clst = new;
+		if (clst != 0) {
+			ASSERT (fat_get (clst) == EOChain);
+			fat_fs->fat[clst] = new;
+
+			/* Maps that end with CLST just get one more cluster. */
+			for (e = list_begin (&fat_maps); e != list_end (&fat_maps);
+					e = list_next (e)) {
+				struct fat_map *map = list_entry (e, struct fat_map, elem);
+				struct fat_run *last;
+
+				if (!map->valid || map->run_cnt == 0)
+					continue;
+				last = &map->runs[map->run_cnt - 1];
+				if (last->clst + last->len - 1 == clst
+						&& !fat_map_push (map, last->ofs + last->len, new))
+					map->valid = false;
+			}
+		}
+	}
+	lock_release (&fat_fs->write_lock);
+	return new;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	struct list_elem *e;
+
+	lock_acquire (&fat_fs->write_lock);
+	if (pclst != 0)
+		fat_fs->fat[pclst] = EOChain;
+
+	/* Maps that hold CLST are built again when next used. */
+	for (e = list_begin (&fat_maps); e != list_end (&fat_maps);
+			e = list_next (e)) {
+		struct fat_map *map = list_entry (e, struct fat_map, elem);
+
+		if (map->valid && fat_map_contains (map, clst))
+			map->valid = false;
+	}
+
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_get (clst);
+
+		fat_fs->fat[clst] = 0;
+		clst = next;
+	}
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	fat_fs->fat[clst] = val;
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
+}
+
+/* Converts sector SECTOR, the first of a cluster, to its cluster #. */
+cluster_t
+sector_to_cluster (disk_sector_t sector) {
+	ASSERT (sector >= fat_fs->data_start);
+	ASSERT ((sector - fat_fs->data_start) % SECTORS_PER_CLUSTER == 0);
+	return (sector - fat_fs->data_start) / SECTORS_PER_CLUSTER + 1;
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
 }
@@ -2,9 +2,12 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/fat.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/page_cache.h"
 #include "filesys/directory.h"
 #include "devices/disk.h"
 
@@ -12,6 +15,8 @@
 struct disk *filesys_disk;
 
 static void do_format (void);
+static bool inode_sector_allocate (disk_sector_t *);
+static void inode_sector_release (disk_sector_t);
 
 /* Initializes the file system module.
  * If FORMAT is true, reformats the file system. */
@@ -21,6 +26,8 @@ filesys_init (bool format) {
 	if (filesys_disk == NULL)
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
+	buffer_cache_init ();
+	page_cache_init ();
 	inode_init ();
 
 #ifdef EFILESYS
@@ -51,6 +58,7 @@ filesys_done (void) {
 #else
 	free_map_close ();
 #endif
+	buffer_cache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -62,11 +70,11 @@ filesys_create (const char *name, off_t initial_size) {
 	disk_sector_t inode_sector = 0;
 	struct dir *dir = dir_open_root ();
 	bool success = (dir != NULL
-			&& free_map_allocate (1, &inode_sector)
+			&& inode_sector_allocate (&inode_sector)
 			&& inode_create (inode_sector, initial_size)
 			&& dir_add (dir, name, inode_sector));
 	if (!success && inode_sector != 0)
-		free_map_release (inode_sector, 1);
+		inode_sector_release (inode_sector);
 	dir_close (dir);
 
 	return success;
@@ -110,6 +118,8 @@ do_format (void) {
 #ifdef EFILESYS
 	/* Create FAT and save it to the disk. */
 	fat_create ();
+	if (!dir_create (cluster_to_sector (ROOT_DIR_CLUSTER), 16))
+		PANIC ("root directory creation failed");
 	fat_close ();
 #else
 	free_map_create ();
@@ -120,3 +130,30 @@ do_format (void) {
 
 	printf ("done.\n");
 }
+
+/* Allocates a sector for a new inode and stores it in *SECTOR.  With
+ * the FAT, that is a one-cluster chain of its own.  Returns false if
+ * the disk is full. */
+static bool
+inode_sector_allocate (disk_sector_t *sector) {
+#ifdef EFILESYS
+	cluster_t clst = fat_create_chain (0);
+
+	if (clst == 0)
+		return false;
+	*sector = cluster_to_sector (clst);
+	return true;
+#else
+	return free_map_allocate (1, sector);
+#endif
+}
+
+/* Frees SECTOR, allocated by inode_sector_allocate(). */
+static void
+inode_sector_release (disk_sector_t sector) {
+#ifdef EFILESYS
+	fat_remove_chain (sector_to_cluster (sector), 0);
+#else
+	free_map_release (sector, 1);
+#endif
+}
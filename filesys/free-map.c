@@ -4,16 +4,23 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/vmalloc.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
 
-/* Initializes the free map. */
+/* Initializes the free map.  The bitmap for a large disk spans many
+ * pages, so it is placed in vmalloc() memory rather than requiring
+ * a physically contiguous run. */
 void
 free_map_init (void) {
-	free_map = bitmap_create (disk_size (filesys_disk));
-	if (free_map == NULL)
+	size_t bit_cnt = disk_size (filesys_disk);
+	size_t buf_size = bitmap_buf_size (bit_cnt);
+	void *buf = vmalloc (buf_size);
+
+	if (buf == NULL)
 		PANIC ("bitmap creation failed--disk is too large");
+	free_map = bitmap_create_in_buf (bit_cnt, buf, buf_size);
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
 }
@@ -36,6 +43,22 @@ free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
 	return sector != BITMAP_ERROR;
 }
 
+/* Allocates the CNT sectors starting at SECTOR from the free map, if
+ * they are all available.
+ * Returns true if successful, false otherwise. */
+bool
+free_map_allocate_at (disk_sector_t sector, size_t cnt) {
+	if (sector + cnt > bitmap_size (free_map)
+			|| !bitmap_none (free_map, sector, cnt))
+		return false;
+	bitmap_set_multiple (free_map, sector, cnt, true);
+	if (free_map_file != NULL && !bitmap_write (free_map, free_map_file)) {
+		bitmap_set_multiple (free_map, sector, cnt, false);
+		return false;
+	}
+	return true;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
@@ -3,6 +3,8 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/fat.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
@@ -10,14 +12,48 @@
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
-/* On-disk inode.
+#ifdef EFILESYS
+/* On-disk inode.  The data is a FAT chain.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
+	cluster_t start;                    /* First cluster of data, or 0. */
 	uint32_t unused[125];               /* Not used. */
 };
+#else
+/* A run of sectors of a file that follow each other on disk. */
+struct extent {
+	uint32_t ofs;                       /* Index of first sector in file. */
+	disk_sector_t start;                /* First sector on disk. */
+	uint32_t length;                    /* Number of sectors. */
+};
+
+/* Extents held by the inode sector itself, and by its overflow block,
+ * for files too fragmented for the first. */
+#define INODE_EXTENTS 41
+#define OVERFLOW_EXTENTS 42
+#define MAX_EXTENTS (INODE_EXTENTS + OVERFLOW_EXTENTS)
+
+/* On-disk inode.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct inode_disk {
+	off_t length;                       /* File size in bytes. */
+	unsigned magic;                     /* Magic number. */
+	uint32_t extent_cnt;                /* Number of extents. */
+	disk_sector_t overflow;             /* Overflow block, or 0. */
+	struct extent extents[INODE_EXTENTS]; /* First extents, in order. */
+	uint32_t unused[1];                 /* Not used. */
+};
+
+/* Overflow block of an inode: the extents after the first
+ * INODE_EXTENTS.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct overflow_disk {
+	struct extent extents[OVERFLOW_EXTENTS];
+	uint32_t unused[2];                 /* Not used. */
+};
+#endif
 
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
@@ -33,19 +69,346 @@ struct inode {
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	unsigned version;                   /* Changes on every write. */
 	struct inode_disk data;             /* Inode content. */
+#ifdef EFILESYS
+	struct fat_map map;                 /* Clusters of the data. */
+#else
+	struct overflow_disk *overflow;     /* Overflow block, if any. */
+#endif
 };
 
+#ifdef EFILESYS
+/* Returns the number of clusters to allocate for an inode SIZE
+ * bytes long. */
+static inline size_t
+bytes_to_clusters (off_t size) {
+	return DIV_ROUND_UP (bytes_to_sectors (size), SECTORS_PER_CLUSTER);
+}
+
+/* Stores in *SECTOR the disk sector that holds sector IDX of INODE's
+ * data, which must have one, and returns how many sectors from there
+ * on follow each other on disk.  The cluster map makes this a binary
+ * search over runs of clusters, however long the chain. */
+static size_t
+find_sectors (struct inode *inode, uint32_t idx, disk_sector_t *sector) {
+	size_t cnt;
+	cluster_t clst = fat_map_lookup (&inode->map, idx / SECTORS_PER_CLUSTER,
+			&cnt);
+
+	ASSERT (clst != 0);
+	*sector = cluster_to_sector (clst) + idx % SECTORS_PER_CLUSTER;
+	return cnt * SECTORS_PER_CLUSTER - idx % SECTORS_PER_CLUSTER;
+}
+
+/* Reads INODE's on-disk inode from INODE->sector and sets up its
+ * cluster map.  Returns false if the sector does not hold an inode. */
+static bool
+inode_read_disk (struct inode *inode) {
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	if (inode->data.magic != INODE_MAGIC)
+		return false;
+	fat_map_init (&inode->map, inode->data.start);
+	return true;
+}
+
+/* Writes INODE's on-disk inode. */
+static void
+inode_write_disk (struct inode *inode) {
+	buffer_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+}
+
+/* Frees the in-memory cluster map of INODE. */
+static void
+inode_release (struct inode *inode) {
+	fat_map_destroy (&inode->map);
+}
+
+/* Frees the clusters of INODE past the first CNT. */
+static void
+inode_truncate_sectors (struct inode *inode, size_t cnt) {
+	cluster_t last;
+
+	if (inode->data.start == 0)
+		return;
+	if (cnt == 0) {
+		fat_remove_chain (inode->data.start, 0);
+		inode->data.start = 0;
+		fat_map_destroy (&inode->map);
+		fat_map_init (&inode->map, 0);
+		return;
+	}
+	last = fat_map_lookup (&inode->map, cnt - 1, NULL);
+	if (last != 0 && fat_get (last) != EOChain)
+		fat_remove_chain (fat_get (last), last);
+}
+
+/* Extends INODE to LENGTH bytes, adding zeroed clusters to the end of
+ * its chain.  Returns false, leaving INODE as it was, if the disk runs
+ * out. */
+static bool
+inode_grow (struct inode *inode, off_t length) {
+	static char zeros[DISK_SECTOR_SIZE];
+	size_t old_cnt = bytes_to_clusters (inode->data.length);
+	size_t need = bytes_to_clusters (length);
+	cluster_t clst = 0;
+	size_t cnt;
+
+	if (old_cnt > 0)
+		clst = fat_map_lookup (&inode->map, old_cnt - 1, NULL);
+	for (cnt = old_cnt; cnt < need; cnt++) {
+		disk_sector_t sector;
+		size_t i;
+
+		clst = fat_create_chain (clst);
+		if (clst == 0)
+			goto fail;
+		if (inode->data.start == 0) {
+			/* The map was of an empty chain. */
+			inode->data.start = clst;
+			fat_map_destroy (&inode->map);
+			fat_map_init (&inode->map, clst);
+		}
+		sector = cluster_to_sector (clst);
+		for (i = 0; i < SECTORS_PER_CLUSTER; i++)
+			buffer_cache_write (sector + i, zeros, 0, DISK_SECTOR_SIZE);
+	}
+	if (length > inode->data.length)
+		inode->data.length = length;
+	inode_write_disk (inode);
+	return true;
+
+fail:
+	inode_truncate_sectors (inode, old_cnt);
+	return false;
+}
+
+/* Frees INODE's own sector and its data, once it is removed. */
+static void
+inode_free_disk (struct inode *inode) {
+	fat_remove_chain (sector_to_cluster (inode->sector), 0);
+	inode_truncate_sectors (inode, 0);
+}
+#else
+
+/* Returns extent I of INODE. */
+static struct extent *
+inode_extent (const struct inode *inode, size_t i) {
+	ASSERT (i < inode->data.extent_cnt);
+	if (i < INODE_EXTENTS)
+		return (struct extent *) &inode->data.extents[i];
+	return &inode->overflow->extents[i - INODE_EXTENTS];
+}
+
+/* Returns the extent of INODE that holds sector IDX of the file, which
+ * must have one, by binary search. */
+static struct extent *
+find_extent (const struct inode *inode, uint32_t idx) {
+	size_t lo = 0, hi = inode->data.extent_cnt;
+
+	ASSERT (hi > 0);
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (inode_extent (inode, mid)->ofs <= idx)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return inode_extent (inode, lo);
+}
+
+/* Stores in *SECTOR the disk sector that holds sector IDX of INODE's
+ * data, which must have one, and returns how many sectors from there
+ * on follow each other on disk. */
+static size_t
+find_sectors (struct inode *inode, uint32_t idx, disk_sector_t *sector) {
+	struct extent *e = find_extent (inode, idx);
+
+	*sector = e->start + (idx - e->ofs);
+	return e->ofs + e->length - idx;
+}
+
+/* Returns the number of sectors INODE has allocated. */
+static size_t
+inode_sectors (const struct inode *inode) {
+	struct extent *e;
+
+	if (inode->data.extent_cnt == 0)
+		return 0;
+	e = inode_extent (inode, inode->data.extent_cnt - 1);
+	return e->ofs + e->length;
+}
+
+/* Reads INODE's on-disk inode from INODE->sector, and its overflow
+ * block if it has one.  Returns false if the sector does not hold an
+ * inode, or if out of memory. */
+static bool
+inode_read_disk (struct inode *inode) {
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	inode->overflow = NULL;
+	if (inode->data.magic != INODE_MAGIC
+			|| inode->data.extent_cnt > MAX_EXTENTS
+			|| (inode->data.extent_cnt > INODE_EXTENTS)
+				!= (inode->data.overflow != 0))
+		return false;
+	if (inode->data.overflow != 0) {
+		inode->overflow = malloc (sizeof *inode->overflow);
+		if (inode->overflow == NULL)
+			return false;
+		buffer_cache_read (inode->data.overflow, inode->overflow, 0,
+				DISK_SECTOR_SIZE);
+	}
+	return true;
+}
+
+/* Writes INODE's on-disk inode and overflow block. */
+static void
+inode_write_disk (struct inode *inode) {
+	buffer_cache_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+	if (inode->overflow != NULL)
+		buffer_cache_write (inode->data.overflow, inode->overflow, 0,
+				DISK_SECTOR_SIZE);
+}
+
+/* Frees the in-memory copy of INODE's overflow block. */
+static void
+inode_release (struct inode *inode) {
+	free (inode->overflow);
+}
+
+/* Frees the sectors of INODE past the first CNT, and its overflow
+ * block if it is no longer needed. */
+static void
+inode_truncate_sectors (struct inode *inode, size_t cnt) {
+	while (inode->data.extent_cnt > 0) {
+		struct extent *e = inode_extent (inode, inode->data.extent_cnt - 1);
+
+		if (e->ofs >= cnt) {
+			free_map_release (e->start, e->length);
+			inode->data.extent_cnt--;
+		} else {
+			if (e->ofs + e->length > cnt) {
+				free_map_release (e->start + (cnt - e->ofs),
+						e->ofs + e->length - cnt);
+				e->length = cnt - e->ofs;
+			}
+			break;
+		}
+	}
+	if (inode->overflow != NULL && inode->data.extent_cnt <= INODE_EXTENTS) {
+		free_map_release (inode->data.overflow, 1);
+		inode->data.overflow = 0;
+		free (inode->overflow);
+		inode->overflow = NULL;
+	}
+}
+
+/* Appends a run of CNT sectors from START to INODE's extents, merging it
+ * into the last one if it follows it on disk.  Returns false if INODE
+ * has no room for another extent. */
+static bool
+inode_add_extent (struct inode *inode, disk_sector_t start, size_t cnt) {
+	size_t n = inode->data.extent_cnt;
+	uint32_t ofs = inode_sectors (inode);
+	struct extent *e;
+
+	if (n > 0) {
+		e = inode_extent (inode, n - 1);
+		if (e->start + e->length == start) {
+			e->length += cnt;
+			return true;
+		}
+	}
+	if (n == MAX_EXTENTS)
+		return false;
+	if (n == INODE_EXTENTS) {
+		inode->overflow = calloc (1, sizeof *inode->overflow);
+		if (inode->overflow == NULL)
+			return false;
+		if (!free_map_allocate (1, &inode->data.overflow)) {
+			free (inode->overflow);
+			inode->overflow = NULL;
+			return false;
+		}
+	}
+	inode->data.extent_cnt++;
+	e = inode_extent (inode, n);
+	e->ofs = ofs;
+	e->start = start;
+	e->length = cnt;
+	return true;
+}
+
+/* Extends INODE to LENGTH bytes, allocating and zeroing the sectors
+ * that takes.  New sectors go right after the last extent if they are
+ * free there, or else wherever the free map has a run of them, asking
+ * for half as many each time none is found.  Returns false, leaving
+ * INODE as it was, if the disk or INODE's extents run out. */
+static bool
+inode_grow (struct inode *inode, off_t length) {
+	static char zeros[DISK_SECTOR_SIZE];
+	size_t old_cnt = inode_sectors (inode);
+	size_t need = bytes_to_sectors (length);
+	size_t cnt = old_cnt;
+
+	while (cnt < need) {
+		size_t chunk = need - cnt;
+		disk_sector_t start = 0;
+		bool ok = false;
+		size_t i;
+
+		if (inode->data.extent_cnt > 0) {
+			struct extent *e = inode_extent (inode,
+					inode->data.extent_cnt - 1);
+
+			start = e->start + e->length;
+			ok = free_map_allocate_at (start, chunk);
+		}
+		while (!ok && chunk > 0)
+			if (!(ok = free_map_allocate (chunk, &start)))
+				chunk /= 2;
+		if (!ok)
+			goto fail;
+		if (!inode_add_extent (inode, start, chunk)) {
+			free_map_release (start, chunk);
+			goto fail;
+		}
+		for (i = 0; i < chunk; i++)
+			buffer_cache_write (start + i, zeros, 0, DISK_SECTOR_SIZE);
+		cnt += chunk;
+	}
+	if (length > inode->data.length)
+		inode->data.length = length;
+	inode_write_disk (inode);
+	return true;
+
+fail:
+	inode_truncate_sectors (inode, old_cnt);
+	return false;
+}
+
+/* Frees INODE's own sector and its data, once it is removed. */
+static void
+inode_free_disk (struct inode *inode) {
+	free_map_release (inode->sector, 1);
+	inode_truncate_sectors (inode, 0);
+}
+#endif
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+	if (pos < inode->data.length) {
+		disk_sector_t sector;
+
+		find_sectors (inode, pos / DISK_SECTOR_SIZE, &sector);
+		return sector;
+	} else
 		return -1;
 }
 
@@ -66,39 +429,36 @@ inode_init (void) {
  * Returns false if memory or disk allocation fails. */
 bool
 inode_create (disk_sector_t sector, off_t length) {
-	struct inode_disk *disk_inode = NULL;
+	struct inode *inode = NULL;
 	bool success = false;
 
 	ASSERT (length >= 0);
 
-	/* If this assertion fails, the inode structure is not exactly
+	/* If these assertions fail, the on-disk structures are not exactly
 	 * one sector in size, and you should fix that. */
-	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
-
-	disk_inode = calloc (1, sizeof *disk_inode);
-	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
-		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
-		free (disk_inode);
+	ASSERT (sizeof inode->data == DISK_SECTOR_SIZE);
+#ifndef EFILESYS
+	ASSERT (sizeof *inode->overflow == DISK_SECTOR_SIZE);
+#endif
+
+	inode = calloc (1, sizeof *inode);
+	if (inode != NULL) {
+		inode->sector = sector;
+		inode->data.magic = INODE_MAGIC;
+#ifdef EFILESYS
+		fat_map_init (&inode->map, 0);
+#endif
+		success = inode_grow (inode, length);
+		inode_release (inode);
+		free (inode);
 	}
 	return success;
 }
 
 /* Reads an inode from SECTOR
  * and returns a `struct inode' that contains it.
- * Returns a null pointer if memory allocation fails. */
+ * Returns a null pointer if memory allocation fails, or if SECTOR does
+ * not hold an inode. */
 struct inode *
 inode_open (disk_sector_t sector) {
 	struct list_elem *e;
@@ -118,14 +478,18 @@ inode_open (disk_sector_t sector) {
 	inode = malloc (sizeof *inode);
 	if (inode == NULL)
 		return NULL;
+	inode->sector = sector;
+	if (!inode_read_disk (inode)) {
+		free (inode);
+		return NULL;
+	}
 
 	/* Initialize. */
 	list_push_front (&open_inodes, &inode->elem);
-	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
+	inode->version = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
 	return inode;
 }
 
@@ -159,11 +523,13 @@ inode_close (struct inode *inode) {
 
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
-			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+			/* So that its stale inode number no longer opens. */
+			inode->data.magic = 0;
+			inode_write_disk (inode);
+			inode_free_disk (inode);
 		}
 
+		inode_release (inode);
 		free (inode); 
 	}
 }
@@ -183,7 +549,6 @@ off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
@@ -200,45 +565,36 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		buffer_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+ * Extends INODE if the write ends past its end.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if INODE cannot grow that far. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
 
 	if (inode->deny_write_cnt)
 		return 0;
+	/* Once before and once after, so that a read that overlaps the
+	 * write in any way sees a change. */
+	inode->version++;
+
+	if (size > 0 && offset + size > inode_length (inode))
+		inode_grow (inode, offset + size);
 
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
@@ -255,38 +611,49 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		/* A write of the whole sector does not read it first. */
+		buffer_cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
+	inode->version++;
 
 	return bytes_written;
 }
 
+/* Stores in *SECTOR the disk sector that holds byte OFFSET of INODE
+ * and returns how many sectors from there on, up to the one holding
+ * byte OFFSET + SIZE - 1, follow each other on disk, so that one disk
+ * command can transfer them.  Returns 0 if OFFSET is past the end of
+ * INODE. */
+size_t
+inode_sector_run (struct inode *inode, off_t offset, off_t size,
+		disk_sector_t *sector) {
+	off_t end = offset + size;
+	uint32_t idx, last;
+	size_t cnt;
+
+	if (size <= 0 || offset >= inode_length (inode))
+		return 0;
+	if (end > inode_length (inode))
+		end = inode_length (inode);
+	idx = offset / DISK_SECTOR_SIZE;
+	last = (end - 1) / DISK_SECTOR_SIZE;
+	cnt = find_sectors (inode, idx, sector);
+	return cnt < last - idx + 1 ? cnt : last - idx + 1;
+}
+
+/* Returns a number that changes whenever INODE is written, so that
+ * copies of its contents can tell whether they are still current. */
+unsigned
+inode_version (const struct inode *inode) {
+	return inode->version;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 	void
@@ -1,9 +1,52 @@
-/* page_cache.c: Implementation of Page Cache (Buffer Cache). */
+/* page_cache.c: Implementation of Page Cache (Buffer Cache).
+ *
+ * Readahead: every open file tracks where its reads go.  A read that
+ * starts where the last one ended continues a sequential stream, and
+ * once the stream reaches the last window read ahead, the next window
+ * is handed to the worker daemon, which reads it into the buffer cache
+ * while the reader goes on.  Windows start at RA_MIN and double up to
+ * RA_MAX.  A read anywhere else halves the window, so random access
+ * soon stops reading ahead at all.
+ *
+ * Requests are sector runs, not offsets, so the daemon needs no
+ * reference to the file.  They are only hints: when the queue is full
+ * they are dropped. */
 
 #include "vm/vm.h"
+#include <stdio.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/inode.h"
+#include "filesys/page_cache.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Smallest and largest readahead windows, in bytes.  The largest is a
+ * quarter of the buffer cache. */
+#define RA_MIN (4 * DISK_SECTOR_SIZE)
+#define RA_MAX (16 * DISK_SECTOR_SIZE)
+
+/* Requests waiting for the worker daemon. */
+#define RA_QUEUE_SIZE 16
+
+/* Request to read CNT sectors from SECTOR into the buffer cache. */
+struct ra_request {
+	disk_sector_t sector;
+	size_t cnt;
+};
+
+static struct ra_request ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head, ra_tail;         /* Next to add, next to take. */
+static struct lock ra_lock;             /* Protects the queue. */
+static struct condition ra_ready;       /* The queue is not empty. */
+
+static long long window_cnt;    /* Windows read ahead. */
+static long long request_cnt;   /* Requests queued. */
+static long long drop_cnt;      /* Requests dropped, the queue being full. */
+
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
+static void page_cache_kworkerd (void *aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations page_cache_op = {
@@ -15,10 +58,104 @@ static const struct page_operations page_cache_op = {
 
 tid_t page_cache_workerd;
 
-/* The initializer of file vm */
+/* The initializer of file vm.  The worker daemon serves every file
+ * read, with or without VM, so page_cache_init() starts it. */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+}
+
+/* Starts the worker daemon that reads ahead. */
+void
+page_cache_init (void) {
+	lock_init (&ra_lock);
+	cond_init (&ra_ready);
+	page_cache_workerd = thread_create ("kworkerd", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
+	if (page_cache_workerd == TID_ERROR)
+		PANIC ("page_cache_init: cannot start worker daemon");
+}
+
+/* Prints readahead statistics. */
+void
+page_cache_print_stats (void) {
+	printf ("Readahead: %lld windows, %lld requests, %lld dropped\n",
+			window_cnt, request_cnt, drop_cnt);
+}
+
+/* Sets up RA for a newly opened file. */
+void
+page_cache_ra_init (struct readahead *ra) {
+	ra->next = 0;
+	ra->ahead = 0;
+	ra->size = 0;
+}
+
+/* Queues the sectors of INODE that hold the SIZE bytes at OFFSET for the
+ * worker daemon. */
+static void
+ra_submit (struct inode *inode, off_t offset, off_t size) {
+	disk_sector_t sector;
+	size_t cnt;
+
+	lock_acquire (&ra_lock);
+	while ((cnt = inode_sector_run (inode, offset, size, &sector)) > 0) {
+		off_t skip = cnt * DISK_SECTOR_SIZE - offset % DISK_SECTOR_SIZE;
+
+		if (ra_head - ra_tail == RA_QUEUE_SIZE) {
+			drop_cnt++;
+			break;
+		}
+		ra_queue[ra_head++ % RA_QUEUE_SIZE] = (struct ra_request) {
+			.sector = sector,
+			.cnt = cnt,
+		};
+		request_cnt++;
+		offset += skip;
+		size -= skip;
+	}
+	cond_signal (&ra_ready, &ra_lock);
+	lock_release (&ra_lock);
+}
+
+/* Tells RA, the readahead state of an open file of INODE, about a read
+ * of SIZE bytes at OFFSET, before it is done, and reads ahead if it
+ * continues a sequential stream. */
+void
+page_cache_ra_read (struct readahead *ra, struct inode *inode, off_t offset,
+		off_t size) {
+	off_t end = offset + size;
+	off_t start;
+
+	if (size <= 0)
+		return;
+	if (offset != ra->next) {
+		/* Random access. */
+		ra->size /= 2;
+		if (ra->size < RA_MIN)
+			ra->size = 0;
+		ra->next = ra->ahead = end;
+		return;
+	}
+	ra->next = end;
+
+	/* Wait until the stream gets into the last window. */
+	if (ra->size > 0 && end <= ra->ahead - ra->size)
+		return;
+
+	if (ra->ahead <= end) {
+		/* Nothing is read ahead, after a random read or at first. */
+		start = end;
+		if (ra->size == 0)
+			ra->size = RA_MIN;
+	} else {
+		start = ra->ahead;
+		ra->size = ra->size * 2 < RA_MAX ? ra->size * 2 : RA_MAX;
+	}
+	if (start >= inode_length (inode))
+		return;
+	ra->ahead = start + ra->size;
+	window_cnt++;
+	ra_submit (inode, start, ra->size);
 }
 
 /* Initialize the page cache */
@@ -44,7 +181,19 @@ static void
 page_cache_destroy (struct page *page) {
 }
 
-/* Worker thread for page cache */
+/* Worker thread for page cache.  Reads the queued requests into the
+ * buffer cache. */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_kworkerd (void *aux UNUSED) {
+	for (;;) {
+		struct ra_request req;
+
+		lock_acquire (&ra_lock);
+		while (ra_head == ra_tail)
+			cond_wait (&ra_ready, &ra_lock);
+		req = ra_queue[ra_tail++ % RA_QUEUE_SIZE];
+		lock_release (&ra_lock);
+
+		buffer_cache_prefetch (req.sector, req.cnt);
+	}
 }
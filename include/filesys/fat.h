@@ -4,6 +4,7 @@
 #include "devices/disk.h"
 #include "filesys/file.h"
 #include <inttypes.h>
+#include <list.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -34,5 +35,22 @@ void fat_remove_chain (
 cluster_t fat_get (cluster_t clst);
 void fat_put (cluster_t clst, cluster_t val);
 disk_sector_t cluster_to_sector (cluster_t clst);
+cluster_t sector_to_cluster (disk_sector_t sector);
+
+/* Map of a cluster chain, so that finding its Nth cluster takes no walk
+ * down the chain.  It is built on first use and kept up to date as the
+ * chain grows, or built again after it shrinks. */
+struct fat_map {
+	struct list_elem elem;      /* Element in the list of maps. */
+	cluster_t start;            /* First cluster of the chain. */
+	bool valid;                 /* Do RUNS describe the chain? */
+	size_t run_cnt;             /* Number of runs. */
+	size_t run_cap;             /* Number of runs allocated. */
+	struct fat_run *runs;       /* Runs of consecutive clusters. */
+};
+
+void fat_map_init (struct fat_map *, cluster_t start);
+void fat_map_destroy (struct fat_map *);
+cluster_t fat_map_lookup (struct fat_map *, size_t idx, size_t *cnt);
 
 #endif /* filesys/fat.h */
@@ -19,5 +19,8 @@ off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+unsigned inode_version (const struct inode *);
+size_t inode_sector_run (struct inode *, off_t offset, off_t size,
+		disk_sector_t *sector);
 
 #endif /* filesys/inode.h */
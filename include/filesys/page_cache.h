@@ -1,12 +1,25 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <stdbool.h>
+#include "filesys/off_t.h"
 
 struct page;
+struct inode;
 enum vm_type;
 
 struct page_cache {};
 
+/* Readahead state of an open file. */
+struct readahead {
+	off_t next;                 /* Where a sequential read would start. */
+	off_t ahead;                /* End of the data read ahead. */
+	off_t size;                 /* Size of the last window, 0 if none. */
+};
+
 void page_cache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+void page_cache_ra_init (struct readahead *);
+void page_cache_ra_read (struct readahead *, struct inode *, off_t offset,
+		off_t size);
+void page_cache_print_stats (void);
 #endif
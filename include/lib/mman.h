@@ -0,0 +1,29 @@
+#ifndef __LIB_MMAN_H
+#define __LIB_MMAN_H
+
+/* Memory mapping flags and advice, shared by the kernel and user
+ * programs. */
+
+/* Flag for mmap(), or'd into its WRITABLE argument: load every page
+ * of the mapping up front instead of on first access. */
+#define MAP_POPULATE 0x2
+
+/* Flag for mmap(), or'd into its WRITABLE argument: writes to the
+ * mapping go to a private copy of each page, never to the file. */
+#define MAP_PRIVATE 0x4
+
+/* Advice for madvise().  The first three describe how a range will be
+ * accessed and stay with its pages; the last two act on the pages
+ * once. */
+#define MADV_NORMAL      0      /* No particular pattern. */
+#define MADV_RANDOM      1      /* Random access: no fault-around. */
+#define MADV_SEQUENTIAL  2      /* Sequential access: read ahead as far
+                                   as possible, evict what is behind. */
+#define MADV_WILLNEED    3      /* Accessed soon: read the pages in. */
+#define MADV_DONTNEED    4      /* Not accessed again: drop the pages. */
+
+/* Flags for msync(); exactly one must be given. */
+#define MS_ASYNC 1              /* Schedule the writes and return. */
+#define MS_SYNC  4              /* Return once the writes are done. */
+
+#endif /* lib/mman.h */
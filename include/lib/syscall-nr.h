@@ -36,6 +36,20 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Memory accounting. */
+	SYS_MEMSTAT,                /* Report a process's memory use. */
+	SYS_SET_RSS_LIMIT,          /* Cap a process's resident pages. */
+	SYS_MADVISE,                /* Advise on the use of a range. */
+	SYS_MSYNC,                  /* Write a mapping back to its file. */
+	SYS_FAULTSTAT,              /* Report page fault statistics. */
+
+	/* Process creation without fork. */
+	SYS_SPAWN,                  /* Start a new process from a file. */
+
+	/* Checkpoint and restore. */
+	SYS_CHECKPOINT,             /* Save the process to a file. */
+	SYS_RESTORE,                /* Resume a process saved to a file. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <mman.h>
+#include <vmstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -13,6 +15,24 @@ typedef int pid_t;
 typedef int off_t;
 #define MAP_FAILED ((void *) NULL)
 
+/* Memory use of a process, in pages, reported by memstat(). */
+struct memstat {
+	size_t rss;                 /* Resident pages. */
+	size_t wss;                 /* Of those, accessed recently. */
+	size_t rss_limit;           /* Most resident pages, 0 if no limit. */
+};
+
+/* A file descriptor action that spawn() applies in the child, in
+ * order, after the child inherits the caller's descriptors. */
+struct spawn_action {
+	int type;                   /* SPAWN_CLOSE or SPAWN_DUP2. */
+	int fd;                     /* Descriptor to close or duplicate. */
+	int newfd;                  /* For SPAWN_DUP2, the duplicate. */
+};
+#define SPAWN_CLOSE 0           /* Close FD, if it is open. */
+#define SPAWN_DUP2 1            /* Make NEWFD a duplicate of FD. */
+#define SPAWN_ACTIONS_MAX 16    /* Most actions for one spawn(). */
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -26,6 +46,8 @@ void exit (int status) NO_RETURN;
 pid_t fork (const char *thread_name);
 int exec (const char *file);
 int wait (pid_t);
+pid_t spawn (const char *cmd_line, const struct spawn_action *actions,
+		size_t action_cnt);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
 int open (const char *file);
@@ -41,6 +63,13 @@ int dup2(int oldfd, int newfd);
 /* Project 3 and optionally project 4. */
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap (void *addr);
+bool memstat (pid_t pid, struct memstat *st);
+bool set_rss_limit (pid_t pid, size_t pages);
+bool madvise (void *addr, size_t length, int advice);
+bool msync (void *addr, size_t length, int flags);
+bool faultstat (struct faultstat *st);
+int checkpoint (const char *file);
+int restore (const char *file);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
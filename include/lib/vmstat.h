@@ -0,0 +1,31 @@
+#ifndef __LIB_VMSTAT_H
+#define __LIB_VMSTAT_H
+
+/* Page fault statistics, shared by the kernel and user programs. */
+
+/* What a page fault did. */
+enum fault_class {
+	FAULT_STACK,                /* Grew the stack. */
+	FAULT_EXEC,                 /* Loaded a page of the executable. */
+	FAULT_ZERO,                 /* Gave a zero-fill page a frame. */
+	FAULT_SWAP,                 /* Read an anonymous page from swap. */
+	FAULT_FILE,                 /* Read a page of a mapped file. */
+	FAULT_COW,                  /* Copied a shared page on a write. */
+	FAULT_WP,                   /* Made a page writable, no copy. */
+	FAULT_FAILED,               /* Could not be handled. */
+	FAULT_CLASS_CNT
+};
+
+/* Buckets of a fault latency histogram.  Bucket B counts the faults
+ * that took [2**B, 2**(B+1)) TSC cycles. */
+#define FAULT_HIST_BUCKETS 64
+
+/* Page faults taken since boot, by class, reported by faultstat().
+ * Latency is the time spent handling the fault, including waits for
+ * other faults and for the disk. */
+struct faultstat {
+	long long count[FAULT_CLASS_CNT];
+	long long cycles[FAULT_CLASS_CNT][FAULT_HIST_BUCKETS];
+};
+
+#endif /* lib/vmstat.h */
@@ -0,0 +1,43 @@
+#ifndef THREADS_MEMTRACK_H
+#define THREADS_MEMTRACK_H
+
+#include <stddef.h>
+
+/* Kernel memory accounting.
+
+   When the kernel is built with MEMTRACK defined (make MEMTRACK=1),
+   every live block handed out by malloc(), calloc(), realloc() and
+   every kernel-pool run handed out by palloc_get_multiple() is
+   recorded together with the address of its caller.  Live and peak
+   byte counts are kept per call site and can be dumped with
+   memtrack_print_stats().
+
+   Without MEMTRACK all of the hooks below expand to nothing. */
+
+/* Which allocator a block came from. */
+enum memtrack_kind {
+	MEMTRACK_MALLOC,            /* malloc(), calloc(), realloc(). */
+	MEMTRACK_PALLOC,            /* palloc_get_multiple() and friends. */
+	MEMTRACK_KIND_CNT
+};
+
+#ifdef MEMTRACK
+void memtrack_init (void);
+void memtrack_alloc (enum memtrack_kind, const void *block, size_t size,
+		const void *site);
+void memtrack_free (enum memtrack_kind, const void *block);
+void memtrack_print_stats (void);
+
+/* Records BLOCK of SIZE bytes as allocated by the caller of the
+   function this macro is expanded in. */
+#define MEMTRACK_ALLOC(KIND, BLOCK, SIZE) \
+	memtrack_alloc ((KIND), (BLOCK), (SIZE), __builtin_return_address (0))
+#define MEMTRACK_FREE(KIND, BLOCK) memtrack_free ((KIND), (BLOCK))
+#else
+#define memtrack_init() ((void) 0)
+#define memtrack_print_stats() ((void) 0)
+#define MEMTRACK_ALLOC(KIND, BLOCK, SIZE) ((void) 0)
+#define MEMTRACK_FREE(KIND, BLOCK) ((void) 0)
+#endif
+
+#endif /* threads/memtrack.h */
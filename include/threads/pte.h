@@ -41,5 +41,12 @@
 #define PTE_U 0x4                        /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20                       /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40                       /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80                      /* 1=maps a large page (PDEs only). */
+
+/* A PDE with PTE_PS set maps a large page of LARGE_PGSIZE bytes
+ * directly, without a page table.  Its A and D bits cover the whole
+ * large page. */
+#define LARGE_PGSIZE (1UL << PDXSHIFT)
+#define LARGE_PGPAGES (LARGE_PGSIZE / PGSIZE)
 
 #endif /* threads/pte.h */
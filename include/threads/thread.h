@@ -135,6 +135,9 @@ struct thread {
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	uintptr_t			user_rsp;        /* User rsp at syscall entry */
+	struct text_image	*image;          /* Cached executable being run */
+	size_t				rss_limit;       /* Most resident pages, 0 if any */
 #endif
 };
 
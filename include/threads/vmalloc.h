@@ -0,0 +1,27 @@
+#ifndef THREADS_VMALLOC_H
+#define THREADS_VMALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Kernel virtual region for virtually contiguous allocations.
+ * It lies in the same page-map-level-4 slot as the direct map of
+ * physical memory (which starts at KERN_BASE), far above any
+ * physical memory Pintos can be given, so every page directory
+ * created by pml4_create() shares it. */
+#define VMALLOC_START 0xc000000000
+#define VMALLOC_SIZE  (256 * 1024 * 1024)
+#define VMALLOC_END   (VMALLOC_START + VMALLOC_SIZE)
+
+/* Returns true if VADDR lies in the vmalloc region. */
+#define is_vmalloc_vaddr(vaddr) \
+	((uint64_t) (vaddr) >= VMALLOC_START && (uint64_t) (vaddr) < VMALLOC_END)
+
+void vmalloc_init (void);
+void *vmalloc (size_t size);
+void vfree (void *);
+void *vmap (void **pages, size_t page_cnt);
+void vunmap (void *);
+
+#endif /* threads/vmalloc.h */
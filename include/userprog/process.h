@@ -3,11 +3,19 @@
 
 #include "threads/thread.h"
 
+struct page;
+struct spawn_action;
+
 tid_t process_create_initd (const char *file_name);
 tid_t process_fork (const char *name, struct intr_frame *if_);
 int process_exec (void *f_name);
+tid_t process_spawn (char *cmd_line, const struct spawn_action *actions,
+		size_t action_cnt);
+int process_checkpoint (const char *path);
+int process_restore (char *path);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (struct thread *next);
+bool process_copy_lazy_page (const struct page *src);
 
 #endif /* userprog/process.h */
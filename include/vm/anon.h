@@ -4,10 +4,18 @@
 struct page;
 enum vm_type;
 
+/* No swap slot. */
+#define SWAP_SLOT_NONE ((size_t) -1)
+
 struct anon_page {
+	size_t slot;                /* Swap slot, or SWAP_SLOT_NONE. */
 };
 
 void vm_anon_init (void);
+void vm_anon_print_stats (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_share (struct page *dst, struct page *src);
+void anon_adopt (struct page *page);
+void anon_discard (struct page *page);
 
 #endif
@@ -5,13 +5,36 @@
 
 struct page;
 enum vm_type;
+struct supplemental_page_table;
+struct text_image;
+
+/* A mapping created by one successful mmap(). */
+struct mmap_region {
+	void *addr;                 /* First mapped page. */
+	size_t page_cnt;            /* Number of mapped pages. */
+	struct file *file;          /* Reopened file, owned by the region. */
+	off_t offset;               /* File offset mapped at ADDR. */
+	size_t length;              /* Bytes backed by the file. */
+	bool writable;
+	bool private;               /* MAP_PRIVATE: writes stay in memory. */
+	struct text_image *image;   /* Frames shared by private mappings. */
+	struct list_elem elem;      /* supplemental_page_table's mmaps. */
+};
 
 struct file_page {
+	struct mmap_region *region; /* Mapping this page belongs to. */
+	bool private;               /* Copied to an anonymous page on write. */
 };
 
 void vm_file_init (void);
+void vm_file_print_stats (void);
 bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+bool file_private_discard (struct page *page);
+bool do_msync (void *addr, size_t length, int flags);
+void do_munmap_all (struct supplemental_page_table *spt);
+bool do_mmap_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src);
 #endif
@@ -0,0 +1,13 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+
+struct frame;
+
+/* Frames the merging daemon looks at per second, or 0 to not run it. */
+extern unsigned ksm_pages_per_sec;
+
+void ksm_init (void);
+void ksm_forget (struct frame *frame);
+void ksm_print_stats (void);
+
+#endif /* vm/ksm.h */
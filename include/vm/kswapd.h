@@ -0,0 +1,14 @@
+#ifndef VM_KSWAPD_H
+#define VM_KSWAPD_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Reclaim in the background?  Set before kswapd_init(). */
+extern bool kswapd_enabled;
+
+void kswapd_init (void);
+bool kswapd_may_allocate (bool speculative);
+bool kswapd_may_allocate_run (size_t cnt);
+void kswapd_print_stats (void);
+
+#endif /* vm/kswapd.h */
@@ -0,0 +1,28 @@
+#ifndef VM_TEXT_H
+#define VM_TEXT_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct inode;
+struct frame;
+struct page;
+
+/* An executable that one or more processes are running.  Opaque. */
+struct text_image;
+
+void text_init (void);
+struct text_image *text_open (struct inode *inode);
+struct text_image *text_open_mapping (struct inode *inode);
+struct text_image *text_create (struct inode *inode, const void *headers,
+		size_t size, off_t file_length);
+const void *text_headers (const struct text_image *image);
+void text_close (struct text_image *image);
+
+struct frame *text_find (struct text_image *image, off_t ofs);
+bool text_share (struct text_image *image, off_t ofs, struct page *page);
+void text_add (struct text_image *image, off_t ofs, struct frame *frame);
+void text_forget (struct frame *frame);
+void text_print_stats (void);
+
+#endif /* vm/text.h */
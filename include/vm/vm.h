@@ -1,6 +1,11 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <stdint.h>
+#include <hash.h>
+#include <list.h>
+#include <mman.h>
+#include <vmstat.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -20,6 +25,12 @@ enum vm_type {
 	VM_MARKER_0 = (1 << 3),
 	VM_MARKER_1 = (1 << 4),
 
+	/* Page belongs to the user stack. */
+	VM_STACK = VM_MARKER_0,
+
+	/* Page of a private file mapping. */
+	VM_PRIVATE = VM_MARKER_1,
+
 	/* DO NOT EXCEED THIS VALUE. */
 	VM_MARKER_END = (1 << 31),
 };
@@ -46,6 +57,14 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	bool writable;         /* Writable by the user? */
+	struct thread *owner;  /* Process whose page table maps this page */
+	struct page *share_next; /* Next page sharing FRAME, circularly */
+	uint8_t ws_history;    /* Accessed bits of the last samples, newest
+	                          lowest; see vm/wss.c */
+	bool referenced;       /* Accessed at a sample since CLOCK looked */
+	uint8_t advice;        /* MADV_NORMAL, MADV_RANDOM or
+	                          MADV_SEQUENTIAL, from madvise() */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -62,9 +81,31 @@ struct page {
 /* The representation of "frame" */
 struct frame {
 	void *kva;
-	struct page *page;
+	struct page *page;          /* One of the pages sharing the frame. */
+	struct list_elem elem;      /* Frame table element. */
+	int ref_cnt;                /* Number of pages sharing the frame. */
+	int pin_cnt;                /* In use by system calls, don't evict. */
+	struct frame **text_slot;   /* Text cache entry for the frame, if any. */
+	struct hash_elem ksm_elem;  /* Same-page merging table element. */
+	uint64_t ksm_sum;           /* Checksum of contents when last scanned. */
+	bool ksm_hashed;            /* In the same-page merging table? */
 };
 
+/* How vm_get_victim() chooses a frame to evict. */
+enum evict_policy {
+	EVICT_CLOCK,                /* Second chance, preferring clean frames. */
+	EVICT_FIFO,                 /* Oldest frame, for comparison. */
+};
+
+extern enum evict_policy vm_evict_policy;
+
+/* Most pages a fault may load around the faulting page. */
+#define FAULT_AROUND_MAX 16
+extern unsigned vm_fault_around;
+
+/* Map aligned zero-fill ranges with large pages? */
+extern bool vm_thp;
+
 /* The function table for page operations.
  * This is one way of implementing "interface" in C.
  * Put the table of "method" into the struct's member, and
@@ -82,11 +123,28 @@ struct page_operations {
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ *
+ * Pages are kept in a radix tree keyed by user virtual page number that
+ * has the same shape as the x86-64 page table: four levels of 512-entry
+ * nodes, each node exactly one page, indexed by the PML4, PDPE, PDX and
+ * PTX fields of the address.  A lookup is four indexed loads; nodes are
+ * allocated on first use and only released when the table is killed. */
+#define SPT_LEVELS 4
+#define SPT_FANOUT 512
+
 struct supplemental_page_table {
+	void **root;           /* Top-level node, or NULL if empty */
+	struct list mmaps;     /* struct mmap_region, by mmap() order */
+	size_t rss;            /* Pages with a frame, other than the zero
+	                          frame.  Protected by vm_lock */
 };
 
+/* Callback for spt_for_each_range(). */
+typedef bool spt_page_func (struct page *, void *aux);
+
+/* Callback for vm_for_each_frame(). */
+typedef void frame_func (struct frame *, void *aux);
+
 #include "threads/thread.h"
 void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
@@ -96,8 +154,12 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+bool spt_for_each_range (struct supplemental_page_table *spt,
+		void *start, void *end, spt_page_func *func, void *aux);
 
 void vm_init (void);
+void vm_print_stats (void);
+void vm_get_fault_stat (struct faultstat *st);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -107,6 +169,30 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
+struct frame *vm_get_free_frame (void);
+struct frame *vm_frame_scan (void);
+bool vm_reclaim_frame (void);
+void vm_for_each_frame (frame_func *func, void *aux);
+bool vm_rss_at_limit (const struct thread *t);
+unsigned vm_fault_around_window (const struct page *page);
+size_t vm_fault_around_prepare (struct page **pages, size_t cnt);
+bool vm_read_frames (struct file *file, off_t ofs, void **kvas, size_t cnt,
+		size_t size);
+bool vm_write_frames (struct file *file, off_t ofs, void **kvas, size_t cnt,
+		size_t size);
+void vm_frame_link (struct frame *frame, struct page *page);
+void vm_frame_share (struct frame *frame, struct page *page);
+void vm_free_frame (struct page *page);
+void vm_lock_acquire (void);
+void vm_lock_release (void);
+bool vm_pin_page (struct page *page);
+void vm_unpin_page (struct page *page);
+bool vm_pin_buffer (void *buffer, size_t size, bool write);
+void vm_unpin_buffer (void *buffer, size_t size);
+bool vm_is_stack_access (void *addr, uintptr_t rsp);
+void vm_populate (void *addr, size_t length);
+bool do_madvise (void *addr, size_t length, int advice);
+void vm_willneed_cancel (struct thread *owner);
 enum vm_type page_get_type (struct page *page);
 
 #endif  /* VM_VM_H */
@@ -0,0 +1,10 @@
+#ifndef VM_WSS_H
+#define VM_WSS_H
+#include <stddef.h>
+
+struct thread;
+
+void wss_init (void);
+size_t wss_estimate (struct thread *t);
+
+#endif /* vm/wss.h */
@@ -95,6 +95,12 @@ wait (pid_t pid) {
 	return syscall1 (SYS_WAIT, pid);
 }
 
+pid_t
+spawn (const char *cmd_line, const struct spawn_action *actions,
+		size_t action_cnt) {
+	return (pid_t) syscall3 (SYS_SPAWN, cmd_line, actions, action_cnt);
+}
+
 bool
 create (const char *file, unsigned initial_size) {
 	return syscall2 (SYS_CREATE, file, initial_size);
@@ -155,6 +161,41 @@ munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+bool
+memstat (pid_t pid, struct memstat *st) {
+	return syscall2 (SYS_MEMSTAT, pid, st);
+}
+
+bool
+set_rss_limit (pid_t pid, size_t pages) {
+	return syscall2 (SYS_SET_RSS_LIMIT, pid, pages);
+}
+
+bool
+madvise (void *addr, size_t length, int advice) {
+	return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+bool
+msync (void *addr, size_t length, int flags) {
+	return syscall3 (SYS_MSYNC, addr, length, flags);
+}
+
+bool
+faultstat (struct faultstat *st) {
+	return syscall1 (SYS_FAULTSTAT, st);
+}
+
+int
+checkpoint (const char *file) {
+	return syscall1 (SYS_CHECKPOINT, file);
+}
+
+int
+restore (const char *file) {
+	return syscall1 (SYS_RESTORE, file);
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
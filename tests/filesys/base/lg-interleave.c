@@ -0,0 +1,46 @@
+/* Grows two files from empty by writing them a block at a time in
+   turn, so that neither can extend its last run of sectors and each
+   ends up in many pieces, then reads both back and checks them. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_SIZE 512
+#define BLOCK_CNT 80
+
+static char buf_a[BLOCK_SIZE * BLOCK_CNT];
+static char buf_b[BLOCK_SIZE * BLOCK_CNT];
+
+void
+test_main (void) 
+{
+  int fd_a, fd_b;
+  int i;
+
+  random_init (0);
+  random_bytes (buf_a, sizeof buf_a);
+  random_bytes (buf_b, sizeof buf_b);
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK ((fd_a = open ("a")) > 1, "open \"a\"");
+  CHECK ((fd_b = open ("b")) > 1, "open \"b\"");
+
+  msg ("write \"a\" and \"b\" alternately");
+  for (i = 0; i < BLOCK_CNT; i++) 
+    {
+      if (write (fd_a, buf_a + i * BLOCK_SIZE, BLOCK_SIZE) != BLOCK_SIZE)
+        fail ("write block %d of \"a\" failed", i);
+      if (write (fd_b, buf_b + i * BLOCK_SIZE, BLOCK_SIZE) != BLOCK_SIZE)
+        fail ("write block %d of \"b\" failed", i);
+    }
+
+  msg ("close \"a\"");
+  close (fd_a);
+  msg ("close \"b\"");
+  close (fd_b);
+
+  check_file ("a", buf_a, sizeof buf_a);
+  check_file ("b", buf_b, sizeof buf_b);
+}
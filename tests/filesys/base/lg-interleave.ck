@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-interleave) begin
+(lg-interleave) create "a"
+(lg-interleave) create "b"
+(lg-interleave) open "a"
+(lg-interleave) open "b"
+(lg-interleave) write "a" and "b" alternately
+(lg-interleave) close "a"
+(lg-interleave) close "b"
+(lg-interleave) open "a" for verification
+(lg-interleave) verified contents of "a"
+(lg-interleave) close "a"
+(lg-interleave) open "b" for verification
+(lg-interleave) verified contents of "b"
+(lg-interleave) close "b"
+(lg-interleave) end
+EOF
+pass;
@@ -0,0 +1,46 @@
+/* Writes out a large file, then reads small pieces of it at
+   random offsets, seeking before each read, and checks them.
+   Finding the sector of an offset must not take time that grows
+   with the file, so this serves as a random-access benchmark. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 153600
+#define READ_SIZE 61
+#define READ_CNT 2000
+
+static char buf[TEST_SIZE];
+static char block[READ_SIZE];
+
+void
+test_main (void) 
+{
+  const char *file_name = "delta";
+  int fd;
+  int i;
+
+  random_init (49);
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+
+  msg ("read \"%s\" at %d random offsets", file_name, READ_CNT);
+  for (i = 0; i < READ_CNT; i++) 
+    {
+      size_t ofs = random_ulong () % (sizeof buf - READ_SIZE + 1);
+
+      seek (fd, ofs);
+      if (read (fd, block, READ_SIZE) != READ_SIZE)
+        fail ("read %d bytes at offset %zu in \"%s\" failed",
+              READ_SIZE, ofs, file_name);
+      compare_bytes (block, buf + ofs, READ_SIZE, ofs, file_name);
+    }
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-seek-read) begin
+(lg-seek-read) create "delta"
+(lg-seek-read) open "delta"
+(lg-seek-read) write "delta"
+(lg-seek-read) read "delta" at 2000 random offsets
+(lg-seek-read) close "delta"
+(lg-seek-read) end
+EOF
+pass;
@@ -0,0 +1,54 @@
+/* Writes out a fairly large file, then reads it back sequentially
+   several times, in blocks much smaller than a sector, to verify
+   that it was written properly.  The file does not fit in the
+   buffer cache, so every pass reads it from disk again, which
+   makes this a benchmark for readahead. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 75678
+#define BLOCK_SIZE 97
+#define PASSES 4
+
+static char buf[TEST_SIZE];
+static char block[BLOCK_SIZE];
+
+void
+test_main (void) 
+{
+  const char *file_name = "brook";
+  int fd;
+  int pass;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+
+  for (pass = 0; pass < PASSES; pass++) 
+    {
+      size_t ofs = 0;
+
+      msg ("read \"%s\", pass %d", file_name, pass);
+      seek (fd, 0);
+      while (ofs < sizeof buf) 
+        {
+          size_t block_size = sizeof buf - ofs;
+          if (block_size > BLOCK_SIZE)
+            block_size = BLOCK_SIZE;
+
+          if (read (fd, block, block_size) != (int) block_size)
+            fail ("read %zu bytes at offset %zu in \"%s\" failed",
+                  block_size, ofs, file_name);
+          compare_bytes (block, buf + ofs, block_size, ofs, file_name);
+          ofs += block_size;
+        }
+    }
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-seq-read) begin
+(lg-seq-read) create "brook"
+(lg-seq-read) open "brook"
+(lg-seq-read) write "brook"
+(lg-seq-read) read "brook", pass 0
+(lg-seq-read) read "brook", pass 1
+(lg-seq-read) read "brook", pass 2
+(lg-seq-read) read "brook", pass 3
+(lg-seq-read) close "brook"
+(lg-seq-read) end
+EOF
+pass;
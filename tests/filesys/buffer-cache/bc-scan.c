@@ -0,0 +1,74 @@
+/* Reads a small file over and over, with a big file that is read
+   only once streamed through in between, and checks that the
+   scan does not push the small file out of the buffer cache.
+   Reports the hit rate of the small file's reads. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* The hot file, and the part of the cold one read each round,
+   which is bigger than the whole cache. */
+#define HOT_SIZE 8192
+#define COLD_CHUNK 40960
+#define ROUNDS 8
+
+static const char hot_name[] = "hot";
+static const char cold_name[] = "cold";
+static char buf[HOT_SIZE];
+static char block[HOT_SIZE];
+
+/* Reads all of the hot file from HOT_FD and checks it.
+   Returns the number of sectors read from disk meanwhile. */
+static long long
+read_hot (int hot_fd) 
+{
+  long long read_cnt = get_fs_disk_read_cnt ();
+
+  seek (hot_fd, 0);
+  if (read (hot_fd, block, sizeof block) != (int) sizeof block)
+    fail ("read \"%s\" failed", hot_name);
+  compare_bytes (block, buf, sizeof block, 0, hot_name);
+  return get_fs_disk_read_cnt () - read_cnt;
+}
+
+void
+test_main (void) 
+{
+  const long long hot_sectors = HOT_SIZE / 512;
+  long long hot_reads = 0;
+  int hot_fd, cold_fd;
+  int round;
+  size_t ofs;
+
+  CHECK (create (cold_name, COLD_CHUNK * ROUNDS), "create \"%s\"", cold_name);
+  CHECK (create (hot_name, sizeof buf), "create \"%s\"", hot_name);
+  CHECK ((hot_fd = open (hot_name)) > 1, "open \"%s\"", hot_name);
+  CHECK ((cold_fd = open (cold_name)) > 1, "open \"%s\"", cold_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (hot_fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", hot_name);
+
+  msg ("warm up \"%s\"", hot_name);
+  read_hot (hot_fd);
+  read_hot (hot_fd);
+
+  msg ("scan \"%s\" in %d rounds", cold_name, ROUNDS);
+  for (round = 0; round < ROUNDS; round++) 
+    {
+      for (ofs = 0; ofs < COLD_CHUNK; ofs += sizeof block)
+        if (read (cold_fd, block, sizeof block) != (int) sizeof block)
+          fail ("read \"%s\" failed", cold_name);
+      hot_reads += read_hot (hot_fd);
+    }
+  msg ("hot set hit rate: %lld%%",
+       100 - hot_reads * 100 / (hot_sectors * ROUNDS));
+
+  CHECK (hot_reads <= hot_sectors,
+         "hot set read from disk at most once");
+  msg ("close \"%s\"", hot_name);
+  close (hot_fd);
+  msg ("close \"%s\"", cold_name);
+  close (cold_fd);
+}
@@ -0,0 +1,32 @@
+# -*- perl -*-
+
+# The hit rate of the hot set varies, so it is only reported.
+
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+my ($rate) = grep (/^\(bc-scan\) hot set hit rate: -?\d+%$/, @output);
+fail "missing hit rate\n" if !defined $rate;
+print "$rate\n";
+@output = grep ($_ ne $rate, @output);
+
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(bc-scan) begin
+(bc-scan) create "cold"
+(bc-scan) create "hot"
+(bc-scan) open "hot"
+(bc-scan) open "cold"
+(bc-scan) write "hot"
+(bc-scan) warm up "hot"
+(bc-scan) scan "cold" in 8 rounds
+(bc-scan) hot set read from disk at most once
+(bc-scan) close "hot"
+(bc-scan) close "cold"
+(bc-scan) end
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Child process run by the spawn tests.
+
+   With no arguments, exits at once; the latency tests start it
+   over and over.  Otherwise each argument names a file
+   descriptor: a plain number must be open on sample.txt, at its
+   start, and a number preceded by '-' must be closed. */
+
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+
+const char *test_name = "child-spawn";
+
+int
+main (int argc, char *argv[]) 
+{
+  int i;
+
+  for (i = 1; i < argc; i++) 
+    {
+      char byte;
+
+      if (argv[i][0] == '-')
+        {
+          int fd = atoi (argv[i] + 1);
+          CHECK (read (fd, &byte, 1) == -1, "fd %d is closed", fd);
+        }
+      else
+        {
+          int fd = atoi (argv[i]);
+          check_file_handle (fd, "sample.txt", sample, sizeof sample - 1);
+          msg ("fd %d holds sample.txt", fd);
+        }
+    }
+  return 0;
+}
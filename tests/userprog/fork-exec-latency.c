@@ -0,0 +1,4 @@
+/* Measures starting processes with fork() and exec(), for
+   comparison with spawn-latency. */
+
+#include "tests/userprog/spawn-latency.inc"
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-exec-latency) begin
+(fork-exec-latency) started 20 children
+(fork-exec-latency) end
+EOF
+pass;
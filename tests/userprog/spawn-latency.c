@@ -0,0 +1,4 @@
+/* Measures starting processes with spawn(). */
+
+#define USE_SPAWN
+#include "tests/userprog/spawn-latency.inc"
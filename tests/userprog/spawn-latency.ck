@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(spawn-latency) begin
+(spawn-latency) started 20 children
+(spawn-latency) end
+EOF
+pass;
@@ -0,0 +1,20 @@
+/* Tries to spawn a nonexistent process, and a process with a
+   file descriptor action on a descriptor that is not open.  Both
+   must fail without a child ever running. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct spawn_action action;
+
+  msg ("spawn(\"no-such-file\"): %d", spawn ("no-such-file", NULL, 0));
+
+  action.type = SPAWN_DUP2;
+  action.fd = 30;
+  action.newfd = 31;
+  msg ("spawn with a bad action: %d", spawn ("child-spawn", &action, 1));
+}
@@ -0,0 +1,34 @@
+/* Spawns a child that inherits two descriptors, duplicating one
+   of them to a new number and closing the other, and checks that
+   the child sees exactly that while the parent's descriptors are
+   left alone. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct spawn_action actions[2];
+  char cmd[64];
+  int fd_a, fd_b;
+  pid_t pid;
+
+  CHECK ((fd_a = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((fd_b = open ("sample.txt")) > 1, "open \"sample.txt\" again");
+
+  actions[0].type = SPAWN_DUP2;
+  actions[0].fd = fd_a;
+  actions[0].newfd = 20;
+  actions[1].type = SPAWN_CLOSE;
+  actions[1].fd = fd_b;
+  snprintf (cmd, sizeof cmd, "child-spawn %d 20 -%d", fd_a, fd_b);
+  CHECK ((pid = spawn (cmd, actions, 2)) != PID_ERROR, "spawn \"%s\"", cmd);
+  msg ("wait(spawn()) = %d", wait (pid));
+
+  check_file_handle (fd_b, "sample.txt", sample, sizeof sample - 1);
+  msg ("fd %d still holds sample.txt", fd_b);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(spawn-simple) begin
+(spawn-simple) open "sample.txt"
+(spawn-simple) open "sample.txt" again
+(spawn-simple) spawn "child-spawn 3 20 -4"
+(child-spawn) fd 3 holds sample.txt
+(child-spawn) fd 20 holds sample.txt
+(child-spawn) fd 4 is closed
+child-spawn: exit(0)
+(spawn-simple) wait(spawn()) = 0
+(spawn-simple) fd 4 still holds sample.txt
+(spawn-simple) end
+spawn-simple: exit(0)
+EOF
+pass;
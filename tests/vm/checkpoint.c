@@ -0,0 +1,48 @@
+/* Checkpoints the process, changes its memory and file position,
+   and restores the checkpoint, checking that the process resumes
+   from checkpoint() with everything as it was then. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+static int counter;
+static char big[3 * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  char buf[16];
+  int handle, r;
+  size_t i;
+
+  CHECK (restore ("missing") == -1, "restore of a missing file fails");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (read (handle, buf, 10) == 10, "read \"sample.txt\"");
+  counter = 42;
+  memset (big, 'x', sizeof big);
+
+  CHECK ((r = checkpoint ("ckpt")) >= 0, "checkpoint");
+  if (r == 0)
+    {
+      counter = 7;
+      memset (big, 0, sizeof big);
+      seek (handle, 0);
+      msg ("restore");
+      restore ("ckpt");
+      fail ("restore returned");
+    }
+
+  msg ("resumed from checkpoint");
+  if (counter != 42)
+    fail ("counter is %d, not 42", counter);
+  for (i = 0; i < sizeof big; i++)
+    if (big[i] != 'x')
+      fail ("big[%zu] is %d, not 'x'", i, big[i]);
+  if (tell (handle) != 10)
+    fail ("file position is %u, not 10", tell (handle));
+  msg ("memory and file position restored");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(checkpoint) begin
+(checkpoint) restore of a missing file fails
+(checkpoint) open "sample.txt"
+(checkpoint) read "sample.txt"
+(checkpoint) checkpoint
+(checkpoint) restore
+(checkpoint) resumed from checkpoint
+(checkpoint) memory and file position restored
+(checkpoint) end
+EOF
+pass;
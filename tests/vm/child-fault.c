@@ -0,0 +1,30 @@
+/* Child process of page-fault-many.
+   Writes to every page of a 4 MB zero-filled array, taking one page
+   fault per page, then checks that every page kept its value.
+   That holds only with transparent huge pages off, which
+   page-fault-many asks for. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+
+const char *test_name = "child-fault";
+
+#define PAGE_SIZE 4096
+#define SIZE (1024 * PAGE_SIZE)
+static char buf[SIZE];
+
+int
+main (void)
+{
+  size_t i;
+
+  /* Top down, so the fault handler sees a descending address stream. */
+  for (i = SIZE; i > 0; i -= PAGE_SIZE)
+    buf[i - PAGE_SIZE] = (i / PAGE_SIZE) & 0xff;
+
+  for (i = 0; i < SIZE; i += PAGE_SIZE)
+    if (buf[i] != (char) ((i / PAGE_SIZE + 1) & 0xff))
+      fail ("page %zu has wrong value", i / PAGE_SIZE);
+
+  return 0x42;
+}
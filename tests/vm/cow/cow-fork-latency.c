@@ -0,0 +1,74 @@
+/* Benchmarks fork of a large address space.  The parent touches
+   2 MB of memory and then forks CHILD_CNT children, one after
+   another.  Each child checks that it shares the parent's frames,
+   writes to a single page, which must then get a frame of its own,
+   and exits.  With copy-on-write only that page is ever copied, so
+   the run time, reported in timer ticks at power-off, stays close
+   to that of forking a small process. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define CHUNK_SIZE (2 * 1024 * 1024)
+#define PAGE_CNT (CHUNK_SIZE / PAGE_SIZE)
+#define CHILD_CNT 20
+
+static char chunk[CHUNK_SIZE];
+static void *pa_parent[CHILD_CNT + 1];
+
+/* Runs in child N.  Exits with N on success. */
+static void
+child (int n) {
+	char *page = chunk + (n + 1) * PAGE_SIZE;
+	size_t i;
+
+	for (i = 0; i < PAGE_CNT; i++)
+		if (chunk[i * PAGE_SIZE] != (char) i)
+			exit (-1);
+	if (get_phys_addr (chunk) != pa_parent[0]
+			|| get_phys_addr (page) != pa_parent[n + 1])
+		exit (-2);
+
+	*page = '@';
+	if (get_phys_addr (page) == pa_parent[n + 1]
+			|| get_phys_addr (chunk) != pa_parent[0])
+		exit (-3);
+	exit (n);
+}
+
+void
+test_main (void)
+{
+	size_t i;
+	int n;
+
+	for (i = 0; i < PAGE_CNT; i++)
+		chunk[i * PAGE_SIZE] = (char) i;
+	for (i = 0; i <= CHILD_CNT; i++)
+		pa_parent[i] = get_phys_addr (chunk + i * PAGE_SIZE);
+
+	for (n = 0; n < CHILD_CNT; n++) {
+		pid_t pid = fork ("child");
+		int status;
+
+		if (pid == 0)
+			child (n);
+		status = wait (pid);
+		if (status != n)
+			fail ("child %d exited with %d", n, status);
+	}
+	msg ("forked %d children", CHILD_CNT);
+
+	for (i = 0; i < PAGE_CNT; i++)
+		if (chunk[i * PAGE_SIZE] != (char) i)
+			fail ("data changed at page %zu", i);
+	for (i = 0; i <= CHILD_CNT; i++)
+		if (get_phys_addr (chunk + i * PAGE_SIZE) != pa_parent[i])
+			fail ("page %zu moved", i);
+	msg ("parent's pages unchanged");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cow-fork-latency) begin
+(cow-fork-latency) forked 20 children
+(cow-fork-latency) parent's pages unchanged
+(cow-fork-latency) end
+EOF
+pass;
@@ -0,0 +1,74 @@
+/* Causes page faults of known classes, including one that kills a
+   child, and checks that faultstat() counts them, and that each
+   class's latency histogram accounts for every fault of the
+   class. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define STACK_PAGES 8
+
+static struct faultstat before, after;
+
+/* Grows the stack by STACK_PAGES pages. */
+static void __attribute__ ((noinline))
+grow_stack (void)
+{
+  volatile char buf[STACK_PAGES * PAGE_SIZE];
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i += PAGE_SIZE)
+    buf[sizeof buf - 1 - i] = i;
+}
+
+void
+test_main (void)
+{
+  char *map = (char *) 0x10000000;
+  volatile char c;
+  int handle;
+  pid_t child;
+  int class, b;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (map, PAGE_SIZE, 0, handle, 0) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+
+  CHECK (faultstat (&before), "faultstat");
+  c = map[0];
+  grow_stack ();
+  child = fork ("child");
+  if (child == 0)
+    {
+      *(volatile char *) NULL = 0;
+      fail ("child survived writing to NULL");
+    }
+  CHECK (wait (child) == -1, "wait for child killed by its fault");
+  CHECK (faultstat (&after), "faultstat again");
+  (void) c;
+
+  if (after.count[FAULT_FILE] <= before.count[FAULT_FILE])
+    fail ("file fault not counted");
+  msg ("file fault counted");
+  if (after.count[FAULT_STACK] <= before.count[FAULT_STACK])
+    fail ("stack growth not counted");
+  msg ("stack growth counted");
+  if (after.count[FAULT_FAILED] <= before.count[FAULT_FAILED])
+    fail ("failed fault not counted");
+  msg ("failed fault counted");
+
+  for (class = 0; class < FAULT_CLASS_CNT; class++)
+    {
+      long long sum = 0;
+
+      for (b = 0; b < FAULT_HIST_BUCKETS; b++)
+        sum += after.cycles[class][b];
+      if (sum != after.count[class])
+        fail ("class %d: histogram holds %lld faults, count is %lld",
+              class, sum, after.count[class]);
+    }
+  msg ("histograms match counts");
+}
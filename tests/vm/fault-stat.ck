@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fault-stat) begin
+(fault-stat) open "sample.txt"
+(fault-stat) mmap "sample.txt"
+(fault-stat) faultstat
+(fault-stat) wait for child killed by its fault
+(fault-stat) faultstat again
+(fault-stat) file fault counted
+(fault-stat) stack growth counted
+(fault-stat) failed fault counted
+(fault-stat) histograms match counts
+(fault-stat) end
+EOF
+pass;
@@ -0,0 +1,56 @@
+/* Gives the kernel every kind of madvise() hint, checking that
+   MAP_POPULATE and the access-pattern hints leave a mapping's
+   contents alone, that MADV_DONTNEED writes a modified mapping back
+   to its file and turns anonymous memory back into zeros, and that
+   bad arguments are refused. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+static char buf[3 * PAGE_SIZE];
+
+void
+test_main (void)
+{
+	char *actual = (char *) 0x10000000;
+	char *anon = (char *) (((uintptr_t) buf + PAGE_SIZE - 1)
+			& ~(uintptr_t) (PAGE_SIZE - 1));
+	int handle;
+	size_t i;
+
+	CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+	CHECK (mmap (actual, PAGE_SIZE, 1 | MAP_POPULATE, handle, 0) != MAP_FAILED,
+			"mmap \"sample.txt\" with MAP_POPULATE");
+	if (memcmp (actual, sample, strlen (sample)))
+		fail ("populated mapping has bad data");
+
+	CHECK (madvise (actual, PAGE_SIZE, MADV_RANDOM), "madvise MADV_RANDOM");
+	CHECK (madvise (actual, PAGE_SIZE, MADV_SEQUENTIAL),
+			"madvise MADV_SEQUENTIAL");
+	CHECK (madvise (actual, PAGE_SIZE, MADV_WILLNEED), "madvise MADV_WILLNEED");
+	if (memcmp (actual, sample, strlen (sample)))
+		fail ("advised mapping has bad data");
+
+	actual[0] = '#';
+	CHECK (madvise (actual, PAGE_SIZE, MADV_DONTNEED),
+			"madvise MADV_DONTNEED on a mapping");
+	if (actual[0] != '#' || memcmp (actual + 1, sample + 1, strlen (sample) - 1))
+		fail ("mapping lost a modification");
+
+	memset (anon, 'x', PAGE_SIZE);
+	CHECK (madvise (anon, PAGE_SIZE, MADV_DONTNEED),
+			"madvise MADV_DONTNEED on anonymous memory");
+	for (i = 0; i < PAGE_SIZE; i++)
+		if (anon[i] != 0)
+			fail ("byte %zu of dropped page is %02hhx (should be 0)", i, anon[i]);
+
+	CHECK (!madvise (anon + 1, PAGE_SIZE, MADV_WILLNEED),
+			"madvise of a misaligned address fails");
+	CHECK (!madvise (anon, PAGE_SIZE, 99), "madvise with bad advice fails");
+}
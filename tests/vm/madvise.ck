@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt" with MAP_POPULATE
+(madvise) madvise MADV_RANDOM
+(madvise) madvise MADV_SEQUENTIAL
+(madvise) madvise MADV_WILLNEED
+(madvise) madvise MADV_DONTNEED on a mapping
+(madvise) madvise MADV_DONTNEED on anonymous memory
+(madvise) madvise of a misaligned address fails
+(madvise) madvise with bad advice fails
+(madvise) end
+EOF
+pass;
@@ -0,0 +1,72 @@
+/* Writes to a file through a mapping and checkpoints it with
+   msync(), checking with read() that the data reached the file
+   while the mapping stays in place.  Only pages modified since
+   the last writeback may be written. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 8
+#define SIZE (PAGE_CNT * PAGE_SIZE)
+#define SECTOR_SIZE 512
+
+static char *map = (char *) 0x10000000;
+static char buf[SIZE];
+
+/* Checks that the file open as HANDLE holds what is mapped. */
+static void
+check_contents (int handle, const char *when)
+{
+  seek (handle, 0);
+  if (read (handle, buf, SIZE) != SIZE)
+    fail ("read of file %s failed", when);
+  if (memcmp (buf, map, SIZE))
+    fail ("file differs from mapping %s", when);
+  msg ("file matches mapping %s", when);
+}
+
+void
+test_main (void)
+{
+  long long writes;
+  int handle, reader;
+
+  CHECK (create ("buffer", SIZE), "create \"buffer\"");
+  CHECK ((handle = open ("buffer")) > 1, "open \"buffer\"");
+  CHECK ((reader = open ("buffer")) > 1, "open \"buffer\" again");
+  CHECK (mmap (map, SIZE, 1, handle, 0) != MAP_FAILED, "mmap \"buffer\"");
+
+  memset (map, 'a', SIZE);
+  CHECK (msync (map, SIZE, MS_SYNC), "msync all pages");
+  check_contents (reader, "after MS_SYNC");
+
+  writes = get_fs_disk_write_cnt ();
+  CHECK (msync (map, SIZE, MS_SYNC), "msync clean pages");
+  if (get_fs_disk_write_cnt () != writes)
+    fail ("clean pages were written back");
+
+  map[3 * PAGE_SIZE + 100] = 'b';
+  writes = get_fs_disk_write_cnt ();
+  CHECK (msync (map, SIZE, MS_SYNC), "msync one dirty page");
+  writes = get_fs_disk_write_cnt () - writes;
+  if (writes > PAGE_SIZE / SECTOR_SIZE)
+    fail ("wrote %lld sectors for one page", writes);
+  check_contents (reader, "after one page");
+
+  memset (map + 4 * PAGE_SIZE, 'c', 4 * PAGE_SIZE);
+  CHECK (msync (map, SIZE, MS_ASYNC), "msync asynchronously");
+  CHECK (msync (map, PAGE_SIZE, MS_SYNC), "msync waits for earlier writes");
+  check_contents (reader, "after MS_ASYNC");
+
+  CHECK (!msync (map + 1, PAGE_SIZE, MS_SYNC), "misaligned msync fails");
+  CHECK (!msync (map, SIZE, MS_SYNC | MS_ASYNC), "msync with both flags fails");
+  CHECK (!msync (map, SIZE + PAGE_SIZE, MS_SYNC),
+         "msync past the mapping fails");
+
+  munmap (map);
+  close (reader);
+  close (handle);
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-msync) begin
+(mmap-msync) create "buffer"
+(mmap-msync) open "buffer"
+(mmap-msync) open "buffer" again
+(mmap-msync) mmap "buffer"
+(mmap-msync) msync all pages
+(mmap-msync) file matches mapping after MS_SYNC
+(mmap-msync) msync clean pages
+(mmap-msync) msync one dirty page
+(mmap-msync) file matches mapping after one page
+(mmap-msync) msync asynchronously
+(mmap-msync) msync waits for earlier writes
+(mmap-msync) file matches mapping after MS_ASYNC
+(mmap-msync) misaligned msync fails
+(mmap-msync) msync with both flags fails
+(mmap-msync) msync past the mapping fails
+(mmap-msync) end
+EOF
+pass;
@@ -0,0 +1,60 @@
+/* Maps a file twice with MAP_PRIVATE and checks that the two
+   mappings share frames until one of them is written, that the
+   write is seen by neither the other mapping nor the file, and
+   that untouched pages stay shared. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SIZE (2 * PAGE_SIZE)
+
+static char *a = (char *) 0x10000000;
+static char *b = (char *) 0x20000000;
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  int handle;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+  CHECK (create ("data", SIZE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (write (handle, buf, SIZE) == SIZE, "write \"data\"");
+
+  CHECK (mmap (a, SIZE, 1 | MAP_PRIVATE, handle, 0) != MAP_FAILED,
+         "mmap \"data\" writable");
+  CHECK (mmap (b, SIZE, 0 | MAP_PRIVATE, handle, 0) != MAP_FAILED,
+         "mmap \"data\" read-only");
+  if (memcmp (a, buf, SIZE) || memcmp (b, buf, SIZE))
+    fail ("mappings differ from file");
+  msg ("mappings match file");
+  if (get_phys_addr (a) != get_phys_addr (b)
+      || get_phys_addr (a + PAGE_SIZE) != get_phys_addr (b + PAGE_SIZE))
+    fail ("mappings do not share frames");
+  msg ("mappings share frames");
+
+  a[100] = 'x';
+  if (get_phys_addr (a) == get_phys_addr (b))
+    fail ("written page still shared");
+  if (b[100] != buf[100])
+    fail ("write seen by other mapping");
+  if (memcmp (a + PAGE_SIZE, buf + PAGE_SIZE, PAGE_SIZE)
+      || get_phys_addr (a + PAGE_SIZE) != get_phys_addr (b + PAGE_SIZE))
+    fail ("unwritten page no longer shared");
+  msg ("write stays private");
+
+  munmap (a);
+  munmap (b);
+  seek (handle, 0);
+  CHECK (read (handle, buf, SIZE) == SIZE, "read \"data\"");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i % 251))
+      fail ("file modified at byte %zu", i);
+  msg ("file unchanged");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-private) begin
+(mmap-private) create "data"
+(mmap-private) open "data"
+(mmap-private) write "data"
+(mmap-private) mmap "data" writable
+(mmap-private) mmap "data" read-only
+(mmap-private) mappings match file
+(mmap-private) mappings share frames
+(mmap-private) write stays private
+(mmap-private) read "data"
+(mmap-private) file unchanged
+(mmap-private) end
+EOF
+pass;
@@ -0,0 +1,30 @@
+/* Runs child-fault 100 times in a row.  Each child takes one page
+   fault per page of a 4 MB array, so the whole test handles more
+   than 100,000 page faults.  Its run time is dominated by the page
+   fault path, which makes it a benchmark for page table lookups.
+   It runs with -thp=off, since a large page would map the array
+   with a couple of faults. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 100
+#define CHILD_PAGES 1024
+
+void
+test_main (void)
+{
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++) {
+    pid_t child = fork ("child-fault");
+    if (child == 0) {
+      if (exec ("child-fault") == -1)
+        fail ("failed to exec child-fault");
+    }
+    if (wait (child) != 0x42)
+      fail ("child %d failed", i);
+  }
+  msg ("%d children faulted %d pages", CHILD_CNT, CHILD_CNT * CHILD_PAGES);
+}
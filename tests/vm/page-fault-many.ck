@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fault-many) begin
+(page-fault-many) 100 children faulted 102400 pages
+(page-fault-many) end
+EOF
+pass;
@@ -0,0 +1,65 @@
+/* Fills a zeroed buffer large enough to hold an aligned 2 MB range,
+   which may be mapped with a huge page, and checks that its pages
+   keep their own contents when a forked child writes them, which
+   splits a huge page copy-on-write, and when one page in the middle
+   is dropped with MADV_DONTNEED. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define HUGE_SIZE (2 * 1024 * 1024)
+#define SIZE (2 * HUGE_SIZE)
+
+static char buf[SIZE];
+
+/* Fails unless every page of BUF starts with its index plus BIAS,
+   skipping page SKIP. */
+static void
+check_pages (int bias, size_t skip)
+{
+	size_t i;
+
+	for (i = 0; i < SIZE / PAGE_SIZE; i++)
+		if (i != skip && buf[i * PAGE_SIZE] != (char) (i + bias))
+			fail ("page %zu holds %d, not %d", i, buf[i * PAGE_SIZE],
+					(char) (i + bias));
+}
+
+void
+test_main (void)
+{
+	char *mid = (char *) (((uintptr_t) buf + HUGE_SIZE - 1)
+			& ~(uintptr_t) (HUGE_SIZE - 1)) + HUGE_SIZE / 2;
+	size_t mid_page = (mid - buf) / PAGE_SIZE;
+	size_t i;
+	pid_t child;
+
+	for (i = 0; i < SIZE; i++)
+		if (buf[i] != 0)
+			fail ("byte %zu is %d before any write", i, buf[i]);
+	for (i = 0; i < SIZE / PAGE_SIZE; i++)
+		buf[i * PAGE_SIZE] = i;
+	msg ("filled");
+
+	child = fork ("child");
+	if (child == 0) {
+		check_pages (0, SIZE);
+		for (i = 0; i < SIZE / PAGE_SIZE; i++)
+			buf[i * PAGE_SIZE] = i + 1;
+		check_pages (1, SIZE);
+		exit (0);
+	}
+	CHECK (wait (child) == 0, "child sees and changes its copy");
+	check_pages (0, SIZE);
+	msg ("parent keeps its contents");
+
+	CHECK (madvise (mid, PAGE_SIZE, MADV_DONTNEED), "drop one page");
+	if (mid[0] != 0)
+		fail ("dropped page holds %d", mid[0]);
+	check_pages (0, mid_page);
+	msg ("other pages keep their contents");
+}
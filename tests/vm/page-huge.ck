@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-huge) begin
+(page-huge) filled
+(page-huge) child sees and changes its copy
+(page-huge) parent keeps its contents
+(page-huge) drop one page
+(page-huge) other pages keep their contents
+(page-huge) end
+EOF
+pass;
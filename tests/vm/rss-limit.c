@@ -0,0 +1,42 @@
+/* Caps the process's resident set with set_rss_limit(), touches
+   more pages than the cap allows, and checks that memstat() finds
+   the process within its limit and that the pages it had to give
+   up for itself kept their contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 64
+#define RSS_LIMIT 32
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+	struct memstat st;
+	size_t i;
+
+	CHECK (memstat (0, &st), "memstat");
+	CHECK (st.rss > 0 && st.rss_limit == 0, "resident, without limit");
+	CHECK (set_rss_limit (0, RSS_LIMIT), "set_rss_limit");
+
+	for (i = 0; i < PAGE_CNT; i++)
+		buf[i * PAGE_SIZE] = i;
+	CHECK (memstat (0, &st), "memstat");
+	if (st.rss > RSS_LIMIT || st.rss_limit != RSS_LIMIT)
+		fail ("%zu pages resident, limit %zu", st.rss, st.rss_limit);
+	if (st.wss > st.rss)
+		fail ("working set of %zu pages, %zu resident", st.wss, st.rss);
+	msg ("resident set within limit");
+
+	for (i = 0; i < PAGE_CNT; i++)
+		if (buf[i * PAGE_SIZE] != (char) i)
+			fail ("page %zu lost its contents", i);
+	msg ("contents kept");
+
+	CHECK (!memstat (-1, &st), "memstat of an unknown process fails");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rss-limit) begin
+(rss-limit) memstat
+(rss-limit) resident, without limit
+(rss-limit) set_rss_limit
+(rss-limit) memstat
+(rss-limit) resident set within limit
+(rss-limit) contents kept
+(rss-limit) memstat of an unknown process fails
+(rss-limit) end
+EOF
+pass;
@@ -17,10 +17,12 @@
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/memtrack.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/vmalloc.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -31,11 +33,16 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/ksm.h"
+#include "vm/kswapd.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/page_cache.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -86,6 +93,7 @@ main (void) {
 	mem_end = palloc_init ();
 	malloc_init ();
 	paging_init (mem_end);
+	vmalloc_init ();
 
 #ifdef USERPROG
 	tss_init ();
@@ -101,6 +109,7 @@ main (void) {
 	exception_init ();
 	syscall_init ();
 #endif
+	memtrack_init ();
 	/* Start thread scheduler and enable interrupts. */
 	thread_start ();
 	serial_init_queue ();
@@ -226,6 +235,54 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-evict")) {
+			if (value != NULL && !strcmp (value, "clock"))
+				vm_evict_policy = EVICT_CLOCK;
+			else if (value != NULL && !strcmp (value, "fifo"))
+				vm_evict_policy = EVICT_FIFO;
+			else
+				PANIC ("unknown eviction policy `%s'", value);
+		}
+		else if (!strcmp (name, "-fault-around")) {
+			int pages = value != NULL ? atoi (value) : -1;
+
+			if (pages < 0 || pages > FAULT_AROUND_MAX)
+				PANIC ("fault-around window must be 0 to %d pages",
+						FAULT_AROUND_MAX);
+			vm_fault_around = pages;
+		}
+		else if (!strcmp (name, "-ksm")) {
+			int rate = value != NULL ? atoi (value) : -1;
+
+			if (rate < 0)
+				PANIC ("same-page merging rate must be 0 or more pages");
+			ksm_pages_per_sec = rate;
+		}
+		else if (!strcmp (name, "-zswap")) {
+			int pages = value != NULL ? atoi (value) : -1;
+
+			if (pages < 0)
+				PANIC ("compressed swap pool must be 0 or more pages");
+			zswap_pool_pages = pages;
+		}
+		else if (!strcmp (name, "-kswapd")) {
+			if (value != NULL && !strcmp (value, "on"))
+				kswapd_enabled = true;
+			else if (value != NULL && !strcmp (value, "off"))
+				kswapd_enabled = false;
+			else
+				PANIC ("-kswapd must be on or off");
+		}
+		else if (!strcmp (name, "-thp")) {
+			if (value != NULL && !strcmp (value, "on"))
+				vm_thp = true;
+			else if (value != NULL && !strcmp (value, "off"))
+				vm_thp = false;
+			else
+				PANIC ("-thp must be on or off");
+		}
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -328,6 +385,14 @@ usage (void) {
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -evict=POLICY      Evict pages by POLICY, clock or fifo.\n"
+			"  -fault-around=N    Load up to N pages after a faulting one.\n"
+			"  -ksm=N             Merge identical pages, scanning N a second.\n"
+			"  -zswap=N           Cache swapped pages compressed in N pages.\n"
+			"  -kswapd=on|off     Reclaim frames in the background (default on).\n"
+			"  -thp=on|off        Map large zero-fill ranges with 2 MB pages.\n"
 #endif
 			);
 	power_off ();
@@ -356,10 +421,16 @@ print_stats (void) {
 	thread_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	buffer_cache_print_stats ();
+	page_cache_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	vm_print_stats ();
+#endif
+	memtrack_print_stats ();
 }
@@ -5,9 +5,11 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/memtrack.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/vmalloc.h"
 
 /* A simple implementation of malloc().
 
@@ -32,7 +34,9 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.  If the
+   kernel pool is too fragmented to supply a contiguous run, the
+   pages come from vmalloc() instead. */
 
 /* Descriptor. */
 struct desc {
@@ -63,6 +67,8 @@ static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *do_malloc (size_t);
+static void do_free (void *);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -83,6 +89,16 @@ malloc_init (void) {
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) {
+	void *p = do_malloc (size);
+	MEMTRACK_ALLOC (MEMTRACK_MALLOC, p, size);
+	return p;
+}
+
+/* Allocates a block of at least SIZE bytes without recording it
+   with memtrack, so that calloc() and realloc() can charge the
+   block to their own callers. */
+static void *
+do_malloc (size_t size) {
 	struct desc *d;
 	struct block *b;
 	struct arena *a;
@@ -101,6 +117,8 @@ malloc (size_t size) {
 		   Allocate enough pages to hold SIZE plus an arena. */
 		size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
 		a = palloc_get_multiple (0, page_cnt);
+		if (a == NULL && page_cnt > 1)
+			a = vmalloc (page_cnt * PGSIZE);
 		if (a == NULL)
 			return NULL;
 
@@ -156,10 +174,11 @@ calloc (size_t a, size_t b) {
 		return NULL;
 
 	/* Allocate and zero memory. */
-	p = malloc (size);
+	p = do_malloc (size);
 	if (p != NULL)
 		memset (p, 0, size);
 
+	MEMTRACK_ALLOC (MEMTRACK_MALLOC, p, size);
 	return p;
 }
 
@@ -185,13 +204,15 @@ realloc (void *old_block, size_t new_size) {
 		free (old_block);
 		return NULL;
 	} else {
-		void *new_block = malloc (new_size);
+		void *new_block = do_malloc (new_size);
 		if (old_block != NULL && new_block != NULL) {
 			size_t old_size = block_size (old_block);
 			size_t min_size = new_size < old_size ? new_size : old_size;
 			memcpy (new_block, old_block, min_size);
-			free (old_block);
+			MEMTRACK_FREE (MEMTRACK_MALLOC, old_block);
+			do_free (old_block);
 		}
+		MEMTRACK_ALLOC (MEMTRACK_MALLOC, new_block, new_size);
 		return new_block;
 	}
 }
@@ -200,6 +221,13 @@ realloc (void *old_block, size_t new_size) {
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) {
+	MEMTRACK_FREE (MEMTRACK_MALLOC, p);
+	do_free (p);
+}
+
+/* Frees block P without updating memtrack. */
+static void
+do_free (void *p) {
 	if (p != NULL) {
 		struct block *b = p;
 		struct arena *a = block_to_arena (b);
@@ -233,7 +261,10 @@ free (void *p) {
 			lock_release (&d->lock);
 		} else {
 			/* It's a big block.  Free its pages. */
-			palloc_free_multiple (a, a->free_cnt);
+			if (is_vmalloc_vaddr (a))
+				vfree (a);
+			else
+				palloc_free_multiple (a, a->free_cnt);
 			return;
 		}
 	}
@@ -0,0 +1,285 @@
+/* memtrack.c: Allocation-site accounting for the kernel heap and the
+   kernel page pool.
+
+   Every tracked block is remembered in a fixed open-addressing hash
+   table keyed by block address, together with its size, the thread
+   that allocated it and the call site it came from.  Call sites live
+   in a second, smaller hash table keyed by return address, which
+   keeps live and peak byte counts.  Both tables are static so that
+   tracking never calls back into the allocators it is watching.
+
+   The whole file compiles to nothing unless MEMTRACK is defined. */
+
+#ifdef MEMTRACK
+#include "threads/memtrack.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Number of live blocks that can be tracked.  Power of 2. */
+#define BLOCK_BITS 13
+#define BLOCK_SLOTS (1 << BLOCK_BITS)
+
+/* Number of distinct call sites.  Power of 2. */
+#define SITE_BITS 8
+#define SITE_SLOTS (1 << SITE_BITS)
+
+/* Maximum number of threads summarized by memtrack_print_stats(). */
+#define TID_SUMMARY_CNT 16
+
+/* A live block.  Kept to 16 bytes since the table is large. */
+struct mt_block {
+	const void *block;          /* Block address, null if slot is free. */
+	uint32_t size;              /* Size in bytes. */
+	uint16_t site;              /* Index into sites[]. */
+	uint16_t tid;               /* Allocating thread, truncated. */
+};
+
+/* An allocation site. */
+struct mt_site {
+	const void *caller;         /* Return address, null if slot is free. */
+	enum memtrack_kind kind;    /* Allocator this site calls. */
+	size_t live_bytes;          /* Bytes currently allocated. */
+	size_t peak_bytes;          /* Maximum of live_bytes. */
+	size_t live_cnt;            /* Blocks currently allocated. */
+	size_t total_cnt;           /* Blocks ever allocated. */
+};
+
+static struct mt_block blocks[BLOCK_SLOTS];
+static size_t block_cnt;
+static struct mt_site sites[SITE_SLOTS];
+
+/* Totals per allocator. */
+static size_t live_bytes[MEMTRACK_KIND_CNT];
+static size_t peak_bytes[MEMTRACK_KIND_CNT];
+
+/* Allocations that could not be recorded because a table was full. */
+static long long dropped_cnt;
+
+static const char *kind_names[MEMTRACK_KIND_CNT] = { "malloc", "palloc" };
+
+/* Returns a BITS-bit hash of pointer P. */
+static inline size_t
+hash_ptr (const void *p, int bits) {
+	return ((uint64_t) p * 0x9e3779b97f4a7c15ULL) >> (64 - bits);
+}
+
+/* Returns the thread running now.  Unlike thread_current() this
+   does not insist on the thread being in THREAD_RUNNING, since
+   pages are freed from inside the scheduler. */
+static inline struct thread *
+current_thread (void) {
+	return pg_round_down (rrsp ());
+}
+
+/* Returns the site slot for CALLER, creating it if needed, or -1 if
+   the site table is full. */
+static int
+site_lookup (const void *caller, enum memtrack_kind kind) {
+	size_t i = hash_ptr (caller, SITE_BITS);
+	size_t n;
+
+	for (n = 0; n < SITE_SLOTS; n++, i = (i + 1) & (SITE_SLOTS - 1)) {
+		struct mt_site *s = &sites[i];
+		if (s->caller == caller)
+			return i;
+		if (s->caller == NULL) {
+			s->caller = caller;
+			s->kind = kind;
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Returns the slot holding BLOCK, or -1 if it is not tracked. */
+static int
+block_lookup (const void *block) {
+	size_t i = hash_ptr (block, BLOCK_BITS);
+
+	for (; blocks[i].block != NULL; i = (i + 1) & (BLOCK_SLOTS - 1))
+		if (blocks[i].block == block)
+			return i;
+	return -1;
+}
+
+/* Empties block slot I, shifting later entries of the same probe
+   run back so that lookups never need tombstones. */
+static void
+block_remove (size_t i) {
+	size_t j = i;
+
+	for (;;) {
+		blocks[i].block = NULL;
+		for (;;) {
+			size_t home;
+
+			j = (j + 1) & (BLOCK_SLOTS - 1);
+			if (blocks[j].block == NULL)
+				return;
+			home = hash_ptr (blocks[j].block, BLOCK_BITS);
+			/* Entry J may move to I only if its home slot does not
+			   lie cyclically within (I, J]. */
+			if (i <= j ? (home <= i || home > j) : (home <= i && home > j))
+				break;
+		}
+		blocks[i] = blocks[j];
+		i = j;
+	}
+}
+
+/* Interrupt 0x45: dump allocation statistics on demand. */
+static void
+memtrack_intr (struct intr_frame *f UNUSED) {
+	memtrack_print_stats ();
+}
+
+/* Registers the on-demand dump interrupt.  User programs may
+   trigger it with "int $0x45". */
+void
+memtrack_init (void) {
+	intr_register_int (0x45, 3, INTR_ON, memtrack_intr,
+			"Dump Kernel Memory Statistics");
+}
+
+/* Records that SITE allocated SIZE bytes at BLOCK. */
+void
+memtrack_alloc (enum memtrack_kind kind, const void *block, size_t size,
+		const void *site) {
+	enum intr_level old_level;
+	size_t i;
+	int s;
+
+	if (block == NULL)
+		return;
+
+	old_level = intr_disable ();
+	s = site_lookup (site, kind);
+
+	/* Never fill the last slot: lookups stop on an empty one. */
+	if (s < 0 || block_cnt + 1 >= BLOCK_SLOTS || block_lookup (block) >= 0) {
+		dropped_cnt++;
+		goto done;
+	}
+
+	for (i = hash_ptr (block, BLOCK_BITS); blocks[i].block != NULL;
+			i = (i + 1) & (BLOCK_SLOTS - 1))
+		continue;
+
+	block_cnt++;
+	blocks[i] = (struct mt_block) {
+		.block = block,
+		.size = size,
+		.site = s,
+		.tid = current_thread ()->tid,
+	};
+
+	sites[s].live_bytes += size;
+	sites[s].live_cnt++;
+	sites[s].total_cnt++;
+	if (sites[s].live_bytes > sites[s].peak_bytes)
+		sites[s].peak_bytes = sites[s].live_bytes;
+
+	live_bytes[kind] += size;
+	if (live_bytes[kind] > peak_bytes[kind])
+		peak_bytes[kind] = live_bytes[kind];
+done:
+	intr_set_level (old_level);
+}
+
+/* Records that BLOCK was released.  Blocks that were never
+   recorded (e.g. allocated before tracking began, or dropped) are
+   ignored. */
+void
+memtrack_free (enum memtrack_kind kind, const void *block) {
+	enum intr_level old_level;
+	int i;
+
+	if (block == NULL)
+		return;
+
+	old_level = intr_disable ();
+	i = block_lookup (block);
+	if (i >= 0) {
+		struct mt_site *s = &sites[blocks[i].site];
+
+		ASSERT (s->kind == kind);
+		s->live_bytes -= blocks[i].size;
+		s->live_cnt--;
+		live_bytes[kind] -= blocks[i].size;
+		block_remove (i);
+		block_cnt--;
+	}
+	intr_set_level (old_level);
+}
+
+/* Prints live and peak usage per allocation site, largest live
+   usage first, followed by live usage per thread.  Blocks that are
+   still live at shutdown are leaks. */
+void
+memtrack_print_stats (void) {
+	static struct mt_site snapshot[SITE_SLOTS];
+	struct { tid_t tid; size_t bytes; } tids[TID_SUMMARY_CNT];
+	size_t tid_cnt = 0, other_bytes = 0;
+	long long dropped;
+	enum intr_level old_level;
+	size_t i, j;
+	int k;
+
+	/* Take a consistent copy, then print without interrupts off. */
+	old_level = intr_disable ();
+	for (i = 0; i < SITE_SLOTS; i++)
+		snapshot[i] = sites[i];
+	for (i = 0; i < BLOCK_SLOTS; i++) {
+		if (blocks[i].block == NULL)
+			continue;
+		for (j = 0; j < tid_cnt; j++)
+			if (tids[j].tid == blocks[i].tid)
+				break;
+		if (j == tid_cnt) {
+			if (tid_cnt == TID_SUMMARY_CNT) {
+				other_bytes += blocks[i].size;
+				continue;
+			}
+			tids[tid_cnt].tid = blocks[i].tid;
+			tids[tid_cnt++].bytes = 0;
+		}
+		tids[j].bytes += blocks[i].size;
+	}
+	dropped = dropped_cnt;
+	intr_set_level (old_level);
+
+	printf ("Memtrack:");
+	for (k = 0; k < MEMTRACK_KIND_CNT; k++)
+		printf (" %s %zu live, %zu peak bytes;",
+				kind_names[k], live_bytes[k], peak_bytes[k]);
+	printf (" %lld untracked\n", dropped);
+
+	/* Selection sort by live bytes; the table is small. */
+	for (;;) {
+		struct mt_site *best = NULL;
+
+		for (i = 0; i < SITE_SLOTS; i++) {
+			struct mt_site *s = &snapshot[i];
+			if (s->caller != NULL
+					&& (best == NULL || s->live_bytes > best->live_bytes))
+				best = s;
+		}
+		if (best == NULL)
+			break;
+		printf ("  %p %-6s %8zu live (%zu blocks), %8zu peak, %zu allocs\n",
+				best->caller, kind_names[best->kind], best->live_bytes,
+				best->live_cnt, best->peak_bytes, best->total_cnt);
+		best->caller = NULL;
+	}
+
+	for (j = 0; j < tid_cnt; j++)
+		printf ("  tid %d: %zu live bytes\n", tids[j].tid, tids[j].bytes);
+	if (other_bytes)
+		printf ("  other threads: %zu live bytes\n", other_bytes);
+}
+#endif /* MEMTRACK */
@@ -8,11 +8,42 @@
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Replaces PDE, which maps a large page, by a page table that maps the
+ * same memory with small pages carrying the same flags.  Returns false
+ * if the page table cannot be allocated. */
+static bool
+pde_split (uint64_t *pde) {
+	uint64_t *pt = palloc_get_page (0);
+	uint64_t pa = PTE_ADDR (*pde);
+	uint64_t flags = *pde & (PTE_P | PTE_W | PTE_U | PTE_A | PTE_D);
+	size_t i;
+
+	if (pt == NULL)
+		return false;
+	for (i = 0; i < LARGE_PGPAGES; i++)
+		pt[i] = (pa + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+
+	/* We do not know which page map PDE is in: drop every TLB entry of
+	 * the running one, in case it is that. */
+	lcr3 (rcr3 ());
+	return true;
+}
+
+/* Returns the address of the PTE for VA in the page directory PDP.
+ * A large page mapping VA is split first if CREATE is true; otherwise
+ * its PDE is returned, whose P, W, U, A and D bits work as a PTE's. */
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
+		if (((uint64_t) pte & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS)) {
+			if (!create)
+				return &pdp[idx];
+			if (!pde_split (&pdp[idx]))
+				return NULL;
+		}
 		if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
@@ -60,7 +91,9 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
  * If PML4E does not have a page table for VADDR, behavior depends
  * on CREATE.  If CREATE is true, then a new page table is
  * created and a pointer into it is returned.  Otherwise, a null
- * pointer is returned. */
+ * pointer is returned.
+ * If VADDR lies in a large page, CREATE splits it into small pages
+ * as well; otherwise the large page's PDE is returned. */
 uint64_t *
 pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	uint64_t *pte = NULL;
@@ -122,7 +155,9 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		/* Large pages are only mapped by the VM, which keeps track of
+		 * them itself. */
+		if ((((uint64_t) pte) & PTE_P) && !(pdp[i] & PTE_PS))
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -169,8 +204,12 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			pt_destroy (PTE_ADDR (pte));
+		if (!(((uint64_t) pte) & PTE_P))
+			continue;
+		/* The VM owns the frames of a large page, and unmaps each page
+		 * before the page map goes. */
+		ASSERT (!(pdp[i] & PTE_PS));
+		pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
 }
@@ -216,8 +255,12 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
-	if (pte && (*pte & PTE_P))
+	if (pte && (*pte & PTE_P)) {
+		if (*pte & PTE_PS)
+			return ptov (PTE_ADDR (*pte))
+				+ ((uint64_t) uaddr & (LARGE_PGSIZE - 1));
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
+	}
 	return NULL;
 }
 
@@ -243,10 +286,69 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 	return pte != NULL;
 }
 
+/* Returns the address of the PDE for VA in PML4, allocating the page
+ * directory pointer table and page directory on the way if CREATE is
+ * true.  Returns a null pointer if one is missing and CREATE is false,
+ * or if it cannot be allocated. */
+static uint64_t *
+pde_walk (uint64_t *pml4, const uint64_t va, bool create) {
+	const int idx[2] = { PML4 (va), PDPE (va) };
+	uint64_t *table = pml4;
+	int level;
+
+	for (level = 0; level < 2; level++) {
+		uint64_t *entry = &table[idx[level]];
+
+		if (!(*entry & PTE_P)) {
+			uint64_t *new_page;
+
+			if (!create || (new_page = palloc_get_page (PAL_ZERO)) == NULL)
+				return NULL;
+			*entry = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+		}
+		table = ptov (PTE_ADDR (*entry));
+	}
+	return &table[PDX (va)];
+}
+
+/* Maps the LARGE_PGSIZE bytes at user virtual address UPAGE to the
+ * physically contiguous memory at kernel virtual address KPAGE with a
+ * single large page, read/write if WRITABLE is true.  Both must be
+ * LARGE_PGSIZE aligned, and no page in the range may be mapped; a page
+ * table left over for the range is freed.  Returns true if successful,
+ * false if memory allocation failed. */
+bool
+pml4_set_large_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	uint64_t *pde;
+
+	ASSERT (((uint64_t) upage & (LARGE_PGSIZE - 1)) == 0);
+	ASSERT (((uint64_t) kpage & (LARGE_PGSIZE - 1)) == 0);
+	ASSERT (is_user_vaddr ((uint8_t *) upage + LARGE_PGSIZE - 1));
+	ASSERT (pml4 != base_pml4);
+
+	pde = pde_walk (pml4, (uint64_t) upage, true);
+	if (pde == NULL)
+		return false;
+	if (*pde & PTE_P) {
+		uint64_t *pt = ptov (PTE_ADDR (*pde));
+		size_t i;
+
+		ASSERT (!(*pde & PTE_PS));
+		for (i = 0; i < LARGE_PGPAGES; i++)
+			ASSERT (!(pt[i] & PTE_P));
+		palloc_free_page (pt);
+	}
+	*pde = vtop (kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	return true;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
- * UPAGE need not be mapped. */
+ * UPAGE need not be mapped.  A large page it lies in is split, so
+ * that only UPAGE is unmapped.  If there is no memory for the page
+ * table, the whole large page is unmapped instead, and its other pages
+ * fault back in one by one. */
 void
 pml4_clear_page (uint64_t *pml4, void *upage) {
 	uint64_t *pte;
@@ -254,6 +356,13 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 	ASSERT (is_user_vaddr (upage));
 
 	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	if (pte != NULL && (*pte & PTE_PS)) {
+		uint64_t *pde = pte;
+
+		pte = pml4e_walk (pml4, (uint64_t) upage, true);
+		if (pte == NULL)
+			pte = pde;
+	}
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
@@ -8,7 +8,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/memtrack.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -31,6 +33,7 @@ struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	size_t free_cnt;                /* Number of free pages. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -42,6 +45,9 @@ static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void pool_count (struct pool *, long delta);
+static void *get_multiple (enum palloc_flags, size_t page_cnt,
+		size_t align);
 
 /* multiboot info */
 struct multiboot_info {
@@ -250,6 +256,10 @@ palloc_init (void) {
 	printf ("\text_mem: 0x%llx ~ 0x%llx (Usable: %'llu kB)\n",
 		  ext_mem.start, ext_mem.end, ext_mem.size / 1024);
 	populate_pools (&base_mem, &ext_mem);
+	kernel_pool.free_cnt = bitmap_count (kernel_pool.used_map, 0,
+			bitmap_size (kernel_pool.used_map), false);
+	user_pool.free_cnt = bitmap_count (user_pool.used_map, 0,
+			bitmap_size (user_pool.used_map), false);
 	return ext_mem.end;
 }
 
@@ -261,16 +271,62 @@ palloc_init (void) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
+	void *pages = get_multiple (flags, page_cnt, 1);
+	if (!(flags & PAL_USER))
+		MEMTRACK_ALLOC (MEMTRACK_PALLOC, pages, page_cnt * PGSIZE);
+	return pages;
+}
+
+/* Like palloc_get_multiple(), but the pages start at an address
+   that is a multiple of PAGE_CNT pages, which must be a power of
+   2, so that they can be mapped by a single large page. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt) {
+	void *pages;
+
+	ASSERT (page_cnt > 0 && (page_cnt & (page_cnt - 1)) == 0);
+
+	pages = get_multiple (flags, page_cnt, page_cnt);
+	if (!(flags & PAL_USER))
+		MEMTRACK_ALLOC (MEMTRACK_PALLOC, pages, page_cnt * PGSIZE);
+	return pages;
+}
+
+/* Finds PAGE_CNT free pages in POOL that start at an address that
+   is a multiple of ALIGN pages, marks them used, and returns the
+   index of the first, or BITMAP_ERROR if there are none.  Must
+   hold POOL's lock. */
+static size_t
+scan_aligned (struct pool *pool, size_t page_cnt, size_t align) {
+	uint64_t base = (uint64_t) pool->base;
+	size_t idx = (ROUND_UP (base, align * PGSIZE) - base) / PGSIZE;
+
+	for (; idx + page_cnt <= bitmap_size (pool->used_map); idx += align)
+		if (bitmap_none (pool->used_map, idx, page_cnt)) {
+			bitmap_set_multiple (pool->used_map, idx, page_cnt, true);
+			return idx;
+		}
+	return BITMAP_ERROR;
+}
+
+/* Does the work of palloc_get_multiple() and palloc_get_aligned(),
+   which record the allocation against their own callers.  The pages
+   are aligned to ALIGN pages. */
+static void *
+get_multiple (enum palloc_flags flags, size_t page_cnt, size_t align) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
 
 	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	size_t page_idx = align > 1
+		? scan_aligned (pool, page_cnt, align)
+		: bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
 	lock_release (&pool->lock);
 	void *pages;
 
-	if (page_idx != BITMAP_ERROR)
+	if (page_idx != BITMAP_ERROR) {
 		pages = pool->base + PGSIZE * page_idx;
-	else
+		pool_count (pool, -(long) page_cnt);
+	} else
 		pages = NULL;
 
 	if (pages) {
@@ -293,7 +349,10 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_page (enum palloc_flags flags) {
-	return palloc_get_multiple (flags, 1);
+	void *page = get_multiple (flags, 1, 1);
+	if (!(flags & PAL_USER))
+		MEMTRACK_ALLOC (MEMTRACK_PALLOC, page, PGSIZE);
+	return page;
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
@@ -306,9 +365,10 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 	if (pages == NULL || page_cnt == 0)
 		return;
 
-	if (page_from_pool (&kernel_pool, pages))
+	if (page_from_pool (&kernel_pool, pages)) {
 		pool = &kernel_pool;
-	else if (page_from_pool (&user_pool, pages))
+		MEMTRACK_FREE (MEMTRACK_PALLOC, pages);
+	} else if (page_from_pool (&user_pool, pages))
 		pool = &user_pool;
 	else
 		NOT_REACHED ();
@@ -320,6 +380,21 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #endif
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	pool_count (pool, page_cnt);
+}
+
+/* Returns the number of free pages in the user pool if FLAGS has
+   PAL_USER set, otherwise in the kernel pool. */
+size_t
+palloc_free_cnt (enum palloc_flags flags) {
+	return (flags & PAL_USER ? &user_pool : &kernel_pool)->free_cnt;
+}
+
+/* Returns the number of pages in the user pool if FLAGS has
+   PAL_USER set, otherwise in the kernel pool. */
+size_t
+palloc_pool_size (enum palloc_flags flags) {
+	return bitmap_size ((flags & PAL_USER ? &user_pool : &kernel_pool)->used_map);
 }
 
 /* Frees the page at PAGE. */
@@ -347,6 +422,16 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
 	*bm_base += bm_pages;
 }
 
+/* Adds DELTA to POOL's count of free pages.  Pages are freed with
+   interrupts off, from the scheduler, so this cannot use the pool's
+   lock. */
+static void
+pool_count (struct pool *pool, long delta) {
+	enum intr_level old_level = intr_disable ();
+	pool->free_cnt += delta;
+	intr_set_level (old_level);
+}
+
 /* Returns true if PAGE was allocated from POOL,
    false otherwise. */
 static bool
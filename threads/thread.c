@@ -548,6 +548,9 @@ init_thread (struct thread *t, const char *name, int priority) {
 	t->is_wait = false;
 	t->exit_status = ALIVE_CHILD;
 	t->run_file = NULL;
+#ifdef VM
+	supplemental_page_table_init (&t->spt);
+#endif
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
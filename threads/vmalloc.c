@@ -0,0 +1,191 @@
+#include "threads/vmalloc.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include "threads/init.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Virtually contiguous kernel memory.
+
+   palloc_get_multiple() can only satisfy a request with a run of
+   physically contiguous pages, which becomes hard to find once the
+   kernel pool is fragmented.  vmalloc() instead takes single pages
+   from the kernel pool wherever they happen to be and maps them
+   side by side into the region [VMALLOC_START, VMALLOC_END).
+
+   Each area is followed by one unmapped guard page.  Besides
+   catching overruns, the guard lets vfree() and vunmap() find the
+   end of an area by walking its page table entries, so no other
+   bookkeeping is needed. */
+
+#define VMALLOC_PAGES (VMALLOC_SIZE / PGSIZE)
+
+static struct bitmap *vmalloc_map;     /* Used pages of the region. */
+static struct lock vmalloc_lock;       /* Protects map and page tables. */
+
+/* Initializes the vmalloc region.  Must be called after the kernel
+   page table is set up and before the first vmalloc(). */
+void
+vmalloc_init (void) {
+	size_t bm_size = bitmap_buf_size (VMALLOC_PAGES);
+	void *bm = palloc_get_multiple (PAL_ASSERT,
+			DIV_ROUND_UP (bm_size, PGSIZE));
+
+	vmalloc_map = bitmap_create_in_buf (VMALLOC_PAGES, bm, bm_size);
+	lock_init (&vmalloc_lock);
+}
+
+/* Maps kernel page KPAGE at VA in the vmalloc region.
+   Returns false if a page table could not be allocated. */
+static bool
+map_page (uint64_t va, void *kpage) {
+	uint64_t *pte = pml4e_walk (base_pml4, va, 1);
+
+	if (pte == NULL)
+		return false;
+	ASSERT ((*pte & PTE_P) == 0);
+	*pte = vtop (kpage) | PTE_P | PTE_W;
+	return true;
+}
+
+/* Unmaps the pages of the area starting at ADDR, up to the first
+   one that is not mapped, freeing them too if FREE_PAGES is true.
+   Returns the number of pages unmapped.  Must hold vmalloc_lock. */
+static size_t
+unmap_pages (void *addr, bool free_pages) {
+	uint64_t va = (uint64_t) addr;
+	size_t page_cnt = 0;
+	uint64_t *pte;
+
+	ASSERT (is_vmalloc_vaddr (addr));
+	ASSERT (pg_ofs (addr) == 0);
+
+	while ((pte = pml4e_walk (base_pml4, va, 0)) != NULL && (*pte & PTE_P)) {
+		void *kpage = ptov (PTE_ADDR (*pte));
+
+		*pte = 0;
+		invlpg (va);
+		if (free_pages)
+			palloc_free_page (kpage);
+		va += PGSIZE;
+		page_cnt++;
+	}
+	return page_cnt;
+}
+
+/* Gives back the PAGE_CNT pages of the area starting at ADDR and its
+   guard page.  Must hold vmalloc_lock. */
+static void
+release_area (void *addr, size_t page_cnt) {
+	bitmap_set_multiple (vmalloc_map, pg_no (addr) - pg_no (VMALLOC_START),
+			page_cnt + 1, false);
+}
+
+/* Unmaps the area starting at ADDR, whose size its guard page marks,
+   freeing its pages too if FREE_PAGES is true.  Must hold
+   vmalloc_lock. */
+static void
+unmap_area (void *addr, bool free_pages) {
+	release_area (addr, unmap_pages (addr, free_pages));
+}
+
+/* Reserves PAGE_CNT pages plus a guard page in the region.
+   Returns the start of the area, or a null pointer if the region
+   is exhausted.  Must hold vmalloc_lock. */
+static void *
+reserve_area (size_t page_cnt) {
+	size_t idx = bitmap_scan_and_flip (vmalloc_map, 0, page_cnt + 1, false);
+
+	if (idx == BITMAP_ERROR)
+		return NULL;
+	return (void *) (VMALLOC_START + (uint64_t) idx * PGSIZE);
+}
+
+/* Maps the PAGE_CNT kernel pages in PAGES, which need not be
+   contiguous, at consecutive virtual addresses and returns the
+   first.  The pages still belong to the caller; undo with
+   vunmap().  Returns a null pointer on failure. */
+void *
+vmap (void **pages, size_t page_cnt) {
+	void *area;
+	size_t i;
+
+	if (page_cnt == 0 || vmalloc_map == NULL)
+		return NULL;
+
+	lock_acquire (&vmalloc_lock);
+	area = reserve_area (page_cnt);
+	if (area != NULL) {
+		for (i = 0; i < page_cnt; i++)
+			if (!map_page ((uint64_t) area + i * PGSIZE, pages[i])) {
+				/* Not all of it is mapped, so the walk would stop short
+				 * of its end. */
+				unmap_pages (area, false);
+				release_area (area, page_cnt);
+				area = NULL;
+				break;
+			}
+	}
+	lock_release (&vmalloc_lock);
+	return area;
+}
+
+/* Removes a mapping created by vmap(). */
+void
+vunmap (void *addr) {
+	if (addr == NULL)
+		return;
+
+	lock_acquire (&vmalloc_lock);
+	unmap_area (addr, false);
+	lock_release (&vmalloc_lock);
+}
+
+/* Allocates SIZE bytes of virtually contiguous, page-aligned kernel
+   memory backed by pages from the kernel pool.  The memory is not
+   zeroed.  Returns a null pointer if the region or the kernel pool
+   is exhausted. */
+void *
+vmalloc (size_t size) {
+	size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+	void *area;
+	size_t i;
+
+	if (page_cnt == 0 || vmalloc_map == NULL)
+		return NULL;
+
+	lock_acquire (&vmalloc_lock);
+	area = reserve_area (page_cnt);
+	if (area != NULL) {
+		for (i = 0; i < page_cnt; i++) {
+			void *kpage = palloc_get_page (0);
+			if (kpage == NULL
+					|| !map_page ((uint64_t) area + i * PGSIZE, kpage)) {
+				if (kpage != NULL)
+					palloc_free_page (kpage);
+				unmap_pages (area, true);
+				release_area (area, page_cnt);
+				area = NULL;
+				break;
+			}
+		}
+	}
+	lock_release (&vmalloc_lock);
+	return area;
+}
+
+/* Frees memory obtained from vmalloc(). */
+void
+vfree (void *addr) {
+	if (addr == NULL)
+		return;
+
+	lock_acquire (&vmalloc_lock);
+	unmap_area (addr, true);
+	lock_release (&vmalloc_lock);
+}
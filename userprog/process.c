@@ -10,22 +10,29 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
+#include "threads/vmalloc.h"
 #include "intrinsic.h"
+#include "lib/user/syscall.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/text.h"
 #endif
 
 static void process_cleanup (void);
 static bool load (const char *file_name, struct intr_frame *if_);
 static void initd (void *f_name);
 static void __do_fork (void *);
+static void __do_spawn (void *);
+static bool load_cmd_line (char *cmd_line, struct intr_frame *if_);
 
 /* General process initializer for initd and other process. */
 static void
@@ -150,7 +157,16 @@ __do_fork (void *aux) {
 		goto error;
 
 	process_activate (current);
+
+	/* Lazily loaded segments are read from the process's own handle
+	 * on the executable. */
+	if (parent->run_file != NULL) {
+		current->run_file = file_duplicate (parent->run_file);
+		if (current->run_file == NULL)
+			goto error;
+	}
 #ifdef VM
+	current->rss_limit = parent->rss_limit;
 	supplemental_page_table_init (&current->spt);
 	if (!supplemental_page_table_copy (&current->spt, &parent->spt))
 		goto error;
@@ -186,25 +202,140 @@ error:
 	// thread_exit ();
 }
 
-/* Switch the current execution context to the f_name.
- * Returns -1 on fail. */
-int
-process_exec (void *f_name) {
-	char *file_name = f_name;
+/* Passed from process_spawn() to the child, on the parent's stack. */
+struct spawn_aux {
+	struct thread *parent;
+	char *cmd_line;                     /* Page holding the command line. */
+	const struct spawn_action *actions;
+	size_t action_cnt;
+	bool success;                       /* Set by the child. */
+};
+
+/* Starts a new process running CMD_LINE, which is in a page that the
+ * caller keeps, without copying anything of the running process but its
+ * file descriptors.  The child applies the ACTION_CNT file descriptor
+ * ACTIONS to those before it loads the program.  Returns the new
+ * process's thread id, or TID_ERROR if the thread cannot be created or
+ * the program cannot be started. */
+tid_t
+process_spawn (char *cmd_line, const struct spawn_action *actions,
+		size_t action_cnt) {
+	struct thread	*parent = thread_current();
+	struct spawn_aux aux;
+	char			name[16];
+	char			*save_ptr;
+	tid_t			tid;
+
+	strlcpy (name, cmd_line, sizeof name);
+	strtok_r (name, " ", &save_ptr);
+
+	aux.parent = parent;
+	aux.cmd_line = cmd_line;
+	aux.actions = actions;
+	aux.action_cnt = action_cnt;
+	aux.success = false;
+	tid = thread_create (name, PRI_DEFAULT, __do_spawn, &aux);
+	if (tid == TID_ERROR)
+		return TID_ERROR;
+	sema_down(&parent->fork_sema);
+	if (!aux.success) {
+		/* Let the child finish exiting. */
+		process_wait (tid);
+		return TID_ERROR;
+	}
+	return tid;
+}
+
+/* Applies ACTION to the running process's file descriptors.  Returns
+ * false if it names a descriptor that is out of range, or duplicates one
+ * that is not open. */
+static bool
+apply_spawn_action (const struct spawn_action *action) {
+	struct thread *current = thread_current ();
+	struct file *dup;
+
+	if (action->fd < 3 || action->fd >= 64)
+		return false;
+	switch (action->type) {
+		case SPAWN_CLOSE:
+			file_close (current->fd_t[action->fd]);
+			current->fd_t[action->fd] = NULL;
+			return true;
+		case SPAWN_DUP2:
+			if (action->newfd < 3 || action->newfd >= 64
+					|| current->fd_t[action->fd] == NULL)
+				return false;
+			if (action->newfd == action->fd)
+				return true;
+			dup = file_duplicate (current->fd_t[action->fd]);
+			if (dup == NULL)
+				return false;
+			file_close (current->fd_t[action->newfd]);
+			current->fd_t[action->newfd] = dup;
+			/* open() hands out descriptors above the last one in use. */
+			if (current->fd <= action->newfd)
+				current->fd = action->newfd + 1;
+			return true;
+		default:
+			return false;
+	}
+}
+
+/* A thread function that starts the program for process_spawn().  The
+ * new process gets a fresh address space straight from the executable;
+ * only the parent's file descriptors are duplicated. */
+static void
+__do_spawn (void *aux_) {
+	struct spawn_aux *aux = aux_;
+	struct thread *parent = aux->parent;
+	struct thread *current = thread_current ();
+	struct intr_frame if_;
+	bool success = true;
+	size_t i;
+
+	for (i = 3; i < 64; i++)
+		if (parent->fd_t[i] != NULL) {
+			current->fd_t[i] = file_duplicate (parent->fd_t[i]);
+			if (current->fd_t[i] == NULL)
+				success = false;
+		}
+	current->fd = parent->fd;
+	for (i = 0; success && i < aux->action_cnt; i++)
+		success = apply_spawn_action (&aux->actions[i]);
+
+#ifdef VM
+	current->rss_limit = parent->rss_limit;
+	supplemental_page_table_init (&current->spt);
+#endif
+	process_init ();
+	if (success)
+		success = load_cmd_line (aux->cmd_line, &if_);
+
+	/* AUX lives on the parent's stack, which may be gone after this. */
+	aux->success = success;
+	sema_up (&parent->fork_sema);
+	if (success)
+		do_iret (&if_);
+
+	/* The parent reports the failure; the child never ran. */
+	current->exit_status = -1;
+	thread_exit ();
+}
+
+/* Loads the program named by the first word of CMD_LINE into the
+ * running thread, which has no address space, and sets up *IF_ to enter
+ * it with the rest of CMD_LINE as its arguments.  CMD_LINE is modified.
+ * Returns true if successful, false otherwise. */
+static bool
+load_cmd_line (char *cmd_line, struct intr_frame *if_) {
+	char *file_name = cmd_line;
 	bool success;
 
-	/* We cannot use the intr_frame in the thread structure.
-	 * This is because when current thread rescheduled,
-	 * it stores the execution information to the member. */
-	struct intr_frame _if;
-	_if.ds = _if.es = _if.ss = SEL_UDSEG;
-	_if.cs = SEL_UCSEG;
-	_if.eflags = FLAG_IF | FLAG_MBS;
+	if_->ds = if_->es = if_->ss = SEL_UDSEG;
+	if_->cs = SEL_UCSEG;
+	if_->eflags = FLAG_IF | FLAG_MBS;
 
-	/* We first kill the current context */
-	process_cleanup ();
-	/* And then load the binary */
-	success = load (file_name, &_if);
+	success = load (file_name, if_);
 	// logic start
 	if (success) {
 		char token, *save_ptr;
@@ -228,29 +359,49 @@ process_exec (void *f_name) {
 		int64_t arg_ptr[argc];
 
 		for (int i = argc - 1; i >= 0; i--) {
-			_if.rsp -= (strlen(arg_list[i]) + 1);
-			arg_ptr[i] = _if.rsp;
-			memcpy(_if.rsp, arg_list[i], strlen(arg_list[i])+ 1);
-			arg_list[i] = _if.rsp;
+			if_->rsp -= (strlen(arg_list[i]) + 1);
+			arg_ptr[i] = if_->rsp;
+			memcpy(if_->rsp, arg_list[i], strlen(arg_list[i])+ 1);
+			arg_list[i] = if_->rsp;
 		}
 		if (total_size%8) {
-			_if.rsp -= (8 - total_size%8);
-			memset(_if.rsp, 0, 8 - total_size%8);
+			if_->rsp -= (8 - total_size%8);
+			memset(if_->rsp, 0, 8 - total_size%8);
 		}
 
-		_if.rsp -= 8;
+		if_->rsp -= 8;
 
-		memset(_if.rsp, 0, sizeof(uint8_t));
+		memset(if_->rsp, 0, sizeof(uint8_t));
 		for (int i = argc - 1; i >= 0; i--) {
-			_if.rsp -= 8;
-			memcpy(_if.rsp, &arg_ptr[i], sizeof(char *));
+			if_->rsp -= 8;
+			memcpy(if_->rsp, &arg_ptr[i], sizeof(char *));
 		}
-		_if.rsp -= 8;
-		memset(_if.rsp, 0, sizeof(void (*)));
+		if_->rsp -= 8;
+		memset(if_->rsp, 0, sizeof(void (*)));
 
-		_if.R.rdi = argc;
-		_if.R.rsi = _if.rsp + 8;
+		if_->R.rdi = argc;
+		if_->R.rsi = if_->rsp + 8;
 	}
+	return success;
+}
+
+/* Switch the current execution context to the f_name.
+ * Returns -1 on fail. */
+int
+process_exec (void *f_name) {
+	char *file_name = f_name;
+	bool success;
+
+	/* We cannot use the intr_frame in the thread structure.
+	 * This is because when current thread rescheduled,
+	 * it stores the execution information to the member. */
+	struct intr_frame _if;
+
+	/* We first kill the current context */
+	process_cleanup ();
+	/* And then load the binary */
+	success = load_cmd_line (file_name, &_if);
+
 	/* If load failed, quit. */
 	palloc_free_page (file_name);
 	if (!success) {
@@ -263,7 +414,6 @@ process_exec (void *f_name) {
 	NOT_REACHED ();
 }
 
-
 int process_wait (tid_t child_tid) {
 	struct thread 		*cur = thread_current();
 	struct thread 		*child = NULL;
@@ -300,7 +450,15 @@ process_exit (void) {
 			file_close(curr->fd_t[i]);
 	}
 	sema_up(&curr->wait_sema);
+#ifdef VM
+	/* Before the executable goes, which MADV_WILLNEED may read. */
+	vm_willneed_cancel (curr);
+	/* Before writes to the executable are allowed again. */
+	text_close (curr->image);
+	curr->image = NULL;
+#endif
 	file_close(curr->run_file);
+	curr->run_file = NULL;
 	sema_down(&curr->exit_sema);
 	process_cleanup ();
 }
@@ -312,7 +470,12 @@ process_cleanup (void) {
 
 #ifdef VM
 	supplemental_page_table_kill (&curr->spt);
+	text_close (curr->image);
+	curr->image = NULL;
 #endif
+	/* exec() replaces the executable, which fork() inherited. */
+	file_close (curr->run_file);
+	curr->run_file = NULL;
 
 	uint64_t *pml4;
 	/* Destroy the current process's page directory and switch back
@@ -396,12 +559,67 @@ struct ELF64_PHDR {
 #define ELF ELF64_hdr
 #define Phdr ELF64_PHDR
 
+/* The executable header and program headers of an executable, as read
+ * by read_headers().  With VM these are kept in the text cache for as
+ * long as some process runs the executable. */
+struct exec_headers {
+	struct ELF ehdr;
+	struct Phdr phdrs[];
+};
+
 static bool setup_stack (struct intr_frame *if_);
 static bool validate_segment (const struct Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		uint32_t read_bytes, uint32_t zero_bytes,
 		bool writable);
 
+/* Reads and verifies the executable header and the program headers of
+ * FILE.  Returns them in a block obtained from malloc(), whose size is
+ * stored in *SIZE, or a null pointer on failure. */
+static struct exec_headers *
+read_headers (struct file *file, const char *file_name, size_t *size) {
+	struct ELF ehdr;
+	struct exec_headers *headers;
+	off_t file_ofs;
+	int i;
+
+	/* Read and verify executable header. */
+	if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
+			|| memcmp (ehdr.e_ident, "\177ELF\2\1\1", 7)
+			|| ehdr.e_type != 2
+			|| ehdr.e_machine != 0x3E // amd64
+			|| ehdr.e_version != 1
+			|| ehdr.e_phentsize != sizeof (struct Phdr)
+			|| ehdr.e_phnum > 1024) {
+		printf ("load: %s: error loading executable\n", file_name);
+		return NULL;
+	}
+
+	*size = sizeof *headers + ehdr.e_phnum * sizeof (struct Phdr);
+	headers = malloc (*size);
+	if (headers == NULL)
+		return NULL;
+	headers->ehdr = ehdr;
+
+	/* Read program headers. */
+	file_ofs = ehdr.e_phoff;
+	for (i = 0; i < ehdr.e_phnum; i++) {
+		if (file_ofs < 0 || file_ofs > file_length (file))
+			goto error;
+		file_seek (file, file_ofs);
+
+		if (file_read (file, &headers->phdrs[i], sizeof (struct Phdr))
+				!= sizeof (struct Phdr))
+			goto error;
+		file_ofs += sizeof (struct Phdr);
+	}
+	return headers;
+
+error:
+	free (headers);
+	return NULL;
+}
+
 /* Loads an ELF executable from FILE_NAME into the current thread.
  * Stores the executable's entry point into *RIP
  * and its initial stack pointer into *RSP.
@@ -409,9 +627,10 @@ static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 load (const char *file_name, struct intr_frame *if_) {
 	struct thread *t = thread_current ();
-	struct ELF ehdr;
+	struct exec_headers *headers = NULL;
+	const struct exec_headers *h;
+	size_t headers_size = 0;
 	struct file *file = NULL;
-	off_t file_ofs;
 	bool success = false;
 	int i;
 	char file_cp[128];
@@ -430,30 +649,24 @@ load (const char *file_name, struct intr_frame *if_) {
 		goto done;
 	}
 	
-	/* Read and verify executable header. */
-	if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
-			|| memcmp (ehdr.e_ident, "\177ELF\2\1\1", 7)
-			|| ehdr.e_type != 2
-			|| ehdr.e_machine != 0x3E // amd64
-			|| ehdr.e_version != 1
-			|| ehdr.e_phentsize != sizeof (struct Phdr)
-			|| ehdr.e_phnum > 1024) {
-		printf ("load: %s: error loading executable\n", file_name);
-		goto done;
+#ifdef VM
+	/* Another process running the same executable parsed its headers
+	 * already. */
+	t->image = text_open (file_get_inode (file));
+	if (t->image != NULL)
+		h = text_headers (t->image);
+	else
+#endif
+	{
+		headers = read_headers (file, file_name, &headers_size);
+		if (headers == NULL)
+			goto done;
+		h = headers;
 	}
 
-	/* Read program headers. */
-	file_ofs = ehdr.e_phoff;
-	for (i = 0; i < ehdr.e_phnum; i++) {
-		struct Phdr phdr;
-
-		if (file_ofs < 0 || file_ofs > file_length (file))
-			goto done;
-		file_seek (file, file_ofs);
+	for (i = 0; i < h->ehdr.e_phnum; i++) {
+		struct Phdr phdr = h->phdrs[i];
 
-		if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-			goto done;
-		file_ofs += sizeof phdr;
 		switch (phdr.p_type) {
 			case PT_NULL:
 			case PT_NOTE:
@@ -499,18 +712,25 @@ load (const char *file_name, struct intr_frame *if_) {
 		goto done;
 
 	/* Start address. */
-	if_->rip = ehdr.e_entry;
+	if_->rip = h->ehdr.e_entry;
 
 	/* TODO: Your code goes here.
 	 * TODO: Implement argument passing (see project2/argument_passing.html). */
 	t->run_file = file;
 	file_deny_write(file);
+#ifdef VM
+	/* Now that writes are denied, the headers stay valid. */
+	if (t->image == NULL)
+		t->image = text_create (file_get_inode (file), headers, headers_size,
+				file_length (file));
+#endif
 
 	success = true;
 
 done:
 	/* We arrive here whether the load is successful or not. */
 	// file_close (file);
+	free (headers);
 	return success;
 }
 
@@ -663,11 +883,107 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
+/* Where lazy_load_segment() finds the contents of one page.  The file
+ * is always the owning process's executable. */
+struct segment_aux {
+	off_t ofs;                  /* File offset of the page. */
+	size_t read_bytes;          /* Bytes to read; the rest is zeroed. */
+};
+
+/* Returns true if PAGE, to be loaded as described by SEG, holds a whole
+ * page of read-only text that the text cache can share. */
+static bool
+is_text_page (struct page *page, struct segment_aux *seg) {
+	return page->owner->image != NULL && !page->writable
+		&& seg->read_bytes == PGSIZE;
+}
+
+/* Loads PAGE from the executable.
+ *
+ * Read-only text that another process running the executable has
+ * loaded already is shared with it through the text cache.
+ *
+ * Fault-around: the pages that follow PAGE in both the address space
+ * and the file and were not loaded yet, up to vm_fault_around_window()
+ * of them, are read along with it by one file read. */
 static bool
 lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
+	struct segment_aux *seg = aux;
+	struct text_image *image = page->owner->image;
+	struct file *file = page->owner->run_file;
+	struct page *pages[FAULT_AROUND_MAX + 1];
+	struct segment_aux *segs[FAULT_AROUND_MAX + 1];
+	void *kvas[FAULT_AROUND_MAX + 1];
+	size_t size = seg->read_bytes;
+	size_t window = vm_fault_around_window (page);
+	size_t cnt = 1;
+	size_t i;
+	bool success;
+
+	if (is_text_page (page, seg) && text_share (image, seg->ofs, page)) {
+		free (seg);
+		return true;
+	}
+
+	pages[0] = page;
+	segs[0] = seg;
+	while (cnt <= window
+			&& size == cnt * PGSIZE) {
+		void *va = (uint8_t *) page->va + cnt * PGSIZE;
+		struct page *next = spt_find_page (&page->owner->spt, va);
+		struct segment_aux *next_seg;
+
+		if (next == NULL || next->frame != NULL
+				|| VM_TYPE (next->operations->type) != VM_UNINIT
+				|| next->uninit.init != lazy_load_segment)
+			break;
+		next_seg = next->uninit.aux;
+		if (next_seg->ofs != seg->ofs + (off_t) (cnt * PGSIZE)
+				|| (is_text_page (next, next_seg)
+					&& text_find (image, next_seg->ofs) != NULL))
+			break;
+		size += next_seg->read_bytes;
+		segs[cnt] = next_seg;
+		pages[cnt++] = next;
+	}
+	cnt = 1 + vm_fault_around_prepare (pages + 1, cnt - 1);
+
+	/* The frames are zeroed by anon_initializer(). */
+	size = 0;
+	for (i = 0; i < cnt; i++) {
+		size += segs[i]->read_bytes;
+		kvas[i] = pages[i]->frame->kva;
+	}
+	success = vm_read_frames (file, seg->ofs, kvas, cnt, size);
+
+	for (i = 0; i < cnt; i++) {
+		if (success && is_text_page (pages[i], segs[i]))
+			text_add (image, segs[i]->ofs, pages[i]->frame);
+		free (segs[i]);
+	}
+	return success;
+}
+
+/* Gives the running process, while fork() copies its parent's pages, a
+ * copy of SRC, a page of the parent's executable that the parent has
+ * not loaded yet.  The copy stays lazy and is read from the child's
+ * own handle on the executable when it is first touched. */
+bool
+process_copy_lazy_page (const struct page *src) {
+	struct segment_aux *aux;
+
+	ASSERT (src->uninit.init == lazy_load_segment);
+
+	aux = malloc (sizeof *aux);
+	if (aux == NULL)
+		return false;
+	*aux = *(struct segment_aux *) src->uninit.aux;
+	if (!vm_alloc_page_with_initializer (src->uninit.type, src->va,
+				src->writable, lazy_load_segment, aux)) {
+		free (aux);
+		return false;
+	}
+	return true;
 }
 
 /* Loads a segment starting at offset OFS in FILE at address
@@ -698,16 +1014,27 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
+		struct segment_aux *aux = NULL;
+
+		/* Pages with nothing to read are plain zeroed memory. */
+		if (page_read_bytes > 0) {
+			aux = malloc (sizeof *aux);
+			if (aux == NULL)
+				return false;
+			aux->ofs = ofs;
+			aux->read_bytes = page_read_bytes;
+		}
 		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
+					writable, aux != NULL ? lazy_load_segment : NULL, aux)) {
+			free (aux);
 			return false;
+		}
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
 		upage += PGSIZE;
+		ofs += page_read_bytes;
 	}
 	return true;
 }
@@ -718,11 +1045,402 @@ setup_stack (struct intr_frame *if_) {
 	bool success = false;
 	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
-
+	if (vm_alloc_page (VM_ANON | VM_STACK, stack_bottom, true)
+			&& vm_claim_page (stack_bottom)) {
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 	return success;
 }
+
+/* Checkpoints.
+ *
+ * checkpoint() writes the running process to a new file: its user
+ * registers, open files, mappings and the contents of its anonymous
+ * pages.  restore() replaces the running process with one read back
+ * from such a file.  The restored process runs the checkpoint file in
+ * place of an executable, and lazy_load_segment() loads its pages from
+ * it on first access, so restoring reads little more than the records.
+ *
+ * The file holds a checkpoint_header, its MAP_CNT checkpoint_maps and
+ * PAGE_CNT checkpoint_pages and then, from DATA_OFS, one page of
+ * contents for each page that is not zero-fill. */
+
+#define CHECKPOINT_MAGIC 0x54504b43     /* "CKPT". */
+
+/* Flags a restored process keeps: CF, PF, AF, ZF, SF, DF and OF. */
+#define CHECKPOINT_FLAGS 0xcd5
+
+/* An open file descriptor. */
+struct checkpoint_fd {
+	bool open;
+	disk_sector_t inumber;              /* Inode of the file. */
+	off_t pos;                          /* Current position. */
+};
+
+struct checkpoint_header {
+	uint32_t magic;                     /* CHECKPOINT_MAGIC. */
+	struct intr_frame if_;              /* User context at checkpoint(). */
+	struct checkpoint_fd fds[64];       /* By file descriptor. */
+	int fd;                             /* Next descriptor for open(). */
+	size_t rss_limit;
+	size_t map_cnt;                     /* Number of checkpoint_maps. */
+	size_t page_cnt;                    /* Number of checkpoint_pages. */
+	off_t data_ofs;                     /* Where page contents start. */
+};
+
+/* A file mapping, made again by do_mmap() on restore. */
+struct checkpoint_map {
+	void *addr;
+	size_t length;                      /* Whole pages. */
+	disk_sector_t inumber;              /* Inode of the mapped file. */
+	off_t offset;
+	bool writable;
+	bool private;                       /* MAP_PRIVATE. */
+};
+
+/* An anonymous page. */
+struct checkpoint_page {
+	void *va;
+	off_t ofs;                          /* Contents, or -1 if zero-fill. */
+	bool writable;
+};
+
+/* State of checkpoint_page() over one walk of the page table. */
+struct checkpoint_state {
+	struct file *file;                  /* Null while counting. */
+	struct checkpoint_page *pages;      /* Records, if FILE is set. */
+	size_t page_max;                    /* Room in PAGES. */
+	size_t page_cnt;                    /* Pages seen. */
+	off_t ofs;                          /* Where the next contents go. */
+};
+
+/* spt_for_each_range() callback for process_checkpoint().  Counts PAGE
+ * if it is anonymous and, on the second walk, records it and writes its
+ * contents, loading it if need be.  Pages of mappings are left to be
+ * read from their files again. */
+static bool
+checkpoint_page (struct page *page, void *state_) {
+	struct checkpoint_state *state = state_;
+	bool zero;
+
+	if (page_get_type (page) != VM_ANON)
+		return true;
+	zero = VM_TYPE (page->operations->type) == VM_UNINIT
+		&& page->uninit.init == NULL;
+
+	if (state->file != NULL) {
+		struct checkpoint_page *rec;
+
+		if (state->page_cnt == state->page_max)
+			return false;
+		rec = &state->pages[state->page_cnt];
+		rec->va = page->va;
+		rec->ofs = zero ? -1 : state->ofs;
+		rec->writable = page->writable;
+		if (!zero) {
+			bool success;
+
+			if (!vm_pin_page (page))
+				return false;
+			success = file_write_at (state->file, page->frame->kva, PGSIZE,
+					state->ofs) == PGSIZE;
+			vm_unpin_page (page);
+			if (!success)
+				return false;
+		}
+	}
+	state->page_cnt++;
+	if (!zero)
+		state->ofs += PGSIZE;
+	return true;
+}
+
+/* Writes the running process to a new file named PATH, from which
+ * process_restore() can later resume it as if checkpoint() returned 1.
+ * The user context saved in intr_f at system call entry is the one
+ * resumed.  Only the mappings are saved, not what they map, so modified
+ * pages of shared mappings are written back first.  Returns 0 if
+ * successful, -1 otherwise. */
+int
+process_checkpoint (const char *path) {
+	struct thread *curr = thread_current ();
+	struct supplemental_page_table *spt = &curr->spt;
+	struct checkpoint_state state = { .file = NULL };
+	struct checkpoint_header *h;
+	struct checkpoint_map *maps = NULL;
+	struct list_elem *e;
+	size_t records_size, i;
+	bool success = false;
+
+	h = calloc (1, sizeof *h);
+	if (h == NULL)
+		return -1;
+	h->magic = CHECKPOINT_MAGIC;
+	h->if_ = curr->intr_f;
+	h->fd = curr->fd;
+	h->rss_limit = curr->rss_limit;
+	for (i = 3; i < 64; i++)
+		if (curr->fd_t[i] != NULL) {
+			h->fds[i].open = true;
+			h->fds[i].inumber = inode_get_inumber (file_get_inode (curr->fd_t[i]));
+			h->fds[i].pos = file_tell (curr->fd_t[i]);
+		}
+	for (e = list_begin (&spt->mmaps); e != list_end (&spt->mmaps);
+			e = list_next (e)) {
+		struct mmap_region *region = list_entry (e, struct mmap_region, elem);
+
+		if (region->writable && !region->private)
+			do_msync (region->addr, region->page_cnt * PGSIZE, MS_SYNC);
+		h->map_cnt++;
+	}
+
+	/* Count the pages and their contents to size the file, which
+	 * cannot grow. */
+	if (!spt_for_each_range (spt, NULL, (void *) KERN_BASE, checkpoint_page,
+				&state))
+		goto done;
+	h->page_cnt = state.page_cnt;
+	records_size = h->map_cnt * sizeof *maps
+		+ h->page_cnt * sizeof *state.pages;
+	h->data_ofs = ROUND_UP (sizeof *h + records_size, PGSIZE);
+
+	maps = vmalloc (records_size);
+	if (maps == NULL)
+		goto done;
+	i = 0;
+	for (e = list_begin (&spt->mmaps); e != list_end (&spt->mmaps);
+			e = list_next (e)) {
+		struct mmap_region *region = list_entry (e, struct mmap_region, elem);
+		struct checkpoint_map *m = &maps[i++];
+
+		m->addr = region->addr;
+		m->length = region->page_cnt * PGSIZE;
+		m->inumber = inode_get_inumber (file_get_inode (region->file));
+		m->offset = region->offset;
+		m->writable = region->writable;
+		m->private = region->private;
+	}
+
+	if (!filesys_create (path, h->data_ofs + state.ofs))
+		goto done;
+	state.file = filesys_open (path);
+	state.pages = (struct checkpoint_page *) (maps + h->map_cnt);
+	state.page_max = h->page_cnt;
+	state.page_cnt = 0;
+	state.ofs = h->data_ofs;
+	/* The header goes last, so that a partial checkpoint is never
+	 * taken for a whole one. */
+	success = state.file != NULL
+		&& spt_for_each_range (spt, NULL, (void *) KERN_BASE,
+				checkpoint_page, &state)
+		&& state.page_cnt == h->page_cnt
+		&& file_write_at (state.file, maps, records_size, sizeof *h)
+			== (off_t) records_size
+		&& file_write_at (state.file, h, sizeof *h, 0) == sizeof *h;
+	file_close (state.file);
+	if (!success)
+		filesys_remove (path);
+
+done:
+	vfree (maps);
+	free (h);
+	return success ? 0 : -1;
+}
+
+/* Opens the file whose inode is in sector INUMBER, or returns a null
+ * pointer.  The file may have been removed since the checkpoint, and
+ * the sector reused, so inode_open() checks that it holds an inode. */
+static struct file *
+checkpoint_open (disk_sector_t inumber) {
+	if (inumber >= disk_size (filesys_disk))
+		return NULL;
+	return file_open (inode_open (inumber));
+}
+
+/* Returns true if the file whose inode is in sector INUMBER can still
+ * be opened. */
+static bool
+checkpoint_file_exists (disk_sector_t inumber) {
+	struct file *file = checkpoint_open (inumber);
+
+	file_close (file);
+	return file != NULL;
+}
+
+/* Reads the header of checkpoint FILE into H and its records into a
+ * new vmalloc() block, stored in *MAPS, which holds the maps followed by
+ * the pages.  Returns false, storing a null pointer, unless FILE is a
+ * whole checkpoint whose records all make sense. */
+static bool
+checkpoint_read (struct file *file, struct checkpoint_header *h,
+		struct checkpoint_map **maps) {
+	off_t length = file_length (file);
+	struct checkpoint_page *pages;
+	size_t records_size, i;
+
+	*maps = NULL;
+	if (file_read_at (file, h, sizeof *h, 0) != sizeof *h
+			|| h->magic != CHECKPOINT_MAGIC
+			|| h->map_cnt > (size_t) length / sizeof **maps
+			|| h->page_cnt > (size_t) length / sizeof *pages)
+		return false;
+	for (i = 3; i < 64; i++)
+		if (h->fds[i].open && !checkpoint_file_exists (h->fds[i].inumber))
+			return false;
+	records_size = h->map_cnt * sizeof **maps + h->page_cnt * sizeof *pages;
+	if (h->data_ofs != (off_t) ROUND_UP (sizeof *h + records_size, PGSIZE)
+			|| h->data_ofs > length)
+		return false;
+
+	*maps = vmalloc (records_size);
+	if (*maps == NULL
+			|| file_read_at (file, *maps, records_size, sizeof *h)
+				!= (off_t) records_size)
+		goto fail;
+	for (i = 0; i < h->map_cnt; i++) {
+		struct checkpoint_map *m = &(*maps)[i];
+
+		if (m->addr == NULL || pg_ofs (m->addr) != 0
+				|| !is_user_vaddr (m->addr) || m->length == 0
+				|| !checkpoint_file_exists (m->inumber))
+			goto fail;
+	}
+	pages = (struct checkpoint_page *) (*maps + h->map_cnt);
+	for (i = 0; i < h->page_cnt; i++) {
+		struct checkpoint_page *p = &pages[i];
+
+		if (pg_ofs (p->va) != 0 || !is_user_vaddr (p->va)
+				|| (p->ofs != -1 && (p->ofs < h->data_ofs
+						|| p->ofs % PGSIZE != 0 || p->ofs > length - PGSIZE)))
+			goto fail;
+	}
+	return true;
+
+fail:
+	vfree (*maps);
+	*maps = NULL;
+	return false;
+}
+
+
+/* Makes the running process, whose old address space is gone, what the
+ * checkpoint in FILE recorded in H, MAPS and the pages that follow MAPS.
+ * Returns false if it could not. */
+static bool
+checkpoint_load (struct file *file, const struct checkpoint_header *h,
+		const struct checkpoint_map *maps) {
+	struct thread *curr = thread_current ();
+	const struct checkpoint_page *pages =
+		(const struct checkpoint_page *) (maps + h->map_cnt);
+	size_t i;
+
+	/* The checkpoint takes the place of the executable. */
+	file_close (curr->run_file);
+	curr->run_file = file;
+	file_deny_write (file);
+
+	curr->pml4 = pml4_create ();
+	if (curr->pml4 == NULL)
+		return false;
+	process_activate (curr);
+	curr->rss_limit = h->rss_limit;
+
+	for (i = 3; i < 64; i++) {
+		file_close (curr->fd_t[i]);
+		curr->fd_t[i] = NULL;
+		if (h->fds[i].open) {
+			curr->fd_t[i] = checkpoint_open (h->fds[i].inumber);
+			if (curr->fd_t[i] == NULL)
+				return false;
+			file_seek (curr->fd_t[i], h->fds[i].pos);
+		}
+	}
+	curr->fd = h->fd;
+
+	for (i = 0; i < h->map_cnt; i++) {
+		const struct checkpoint_map *m = &maps[i];
+		struct file *mapped = checkpoint_open (m->inumber);
+		bool success;
+
+		if (mapped == NULL)
+			return false;
+		success = do_mmap (m->addr, m->length,
+				m->writable | (m->private ? MAP_PRIVATE : 0), mapped,
+				m->offset) != NULL;
+		file_close (mapped);
+		if (!success)
+			return false;
+	}
+
+	for (i = 0; i < h->page_cnt; i++) {
+		const struct checkpoint_page *p = &pages[i];
+		struct page *old = spt_find_page (&curr->spt, p->va);
+		struct segment_aux *aux;
+
+		/* A written page of a private mapping. */
+		if (old != NULL) {
+			vm_lock_acquire ();
+			spt_remove_page (&curr->spt, old);
+			vm_lock_release ();
+		}
+		if (p->ofs == -1) {
+			if (!vm_alloc_page (VM_ANON, p->va, p->writable))
+				return false;
+			continue;
+		}
+		aux = malloc (sizeof *aux);
+		if (aux == NULL)
+			return false;
+		aux->ofs = p->ofs;
+		aux->read_bytes = PGSIZE;
+		if (!vm_alloc_page_with_initializer (VM_ANON, p->va, p->writable,
+					lazy_load_segment, aux)) {
+			free (aux);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Replaces the running process with the one checkpointed by
+ * process_checkpoint() to the file named PATH, and resumes that one.
+ * PATH is in a page that this function frees, like process_exec().
+ * Returns -1, leaving the running process as it was, if PATH cannot be
+ * opened, is not a checkpoint or records files that no longer exist.
+ * Otherwise does not return; if the
+ * process cannot be rebuilt after all, it exits. */
+int
+process_restore (char *path) {
+	struct checkpoint_header *h = malloc (sizeof *h);
+	struct checkpoint_map *maps = NULL;
+	struct intr_frame if_;
+	struct file *file;
+
+	file = filesys_open (path);
+	palloc_free_page (path);
+	if (h == NULL || file == NULL || !checkpoint_read (file, h, &maps)) {
+		file_close (file);
+		free (h);
+		return -1;
+	}
+
+	process_cleanup ();
+	if (!checkpoint_load (file, h, maps)) {
+		vfree (maps);
+		free (h);
+		exit (-1);
+	}
+
+	/* Only user segments and flags, whatever the file says. */
+	if_ = h->if_;
+	if_.ds = if_.es = if_.ss = SEL_UDSEG;
+	if_.cs = SEL_UCSEG;
+	if_.eflags = (if_.eflags & CHECKPOINT_FLAGS) | FLAG_IF | FLAG_MBS;
+	if_.R.rax = 1;
+	vfree (maps);
+	free (h);
+	do_iret (&if_);
+	NOT_REACHED ();
+}
 #endif /* VM */
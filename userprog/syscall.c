@@ -1,5 +1,6 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -10,6 +11,10 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "threads/palloc.h"
+#include "userprog/process.h"
+#ifdef VM
+#include "vm/wss.h"
+#endif
 
 
 #include "lib/user/syscall.h"
@@ -25,6 +30,8 @@ int			wait (pid_t pid);
 
 pid_t		fork (const char *thread_name);
 int			exec (const char *cmd_line);
+pid_t		spawn (const char *cmd_line, const struct spawn_action *actions,
+					size_t action_cnt);
 
 bool		create (const char *file, unsigned initial_size);
 bool		remove (const char *file);
@@ -35,6 +42,17 @@ int			read (int fd, void *buffer, unsigned size);
 int			write (int fd, const void *buffer, unsigned size);
 void		seek (int fd, unsigned position);
 unsigned	tell (int fd);
+#ifdef VM
+void		*mmap (void *addr, size_t length, int writable, int fd, off_t offset);
+void		munmap (void *addr);
+bool		memstat (pid_t pid, struct memstat *st);
+bool		set_rss_limit (pid_t pid, size_t pages);
+bool		madvise (void *addr, size_t length, int advice);
+bool		msync (void *addr, size_t length, int flags);
+bool		faultstat (struct faultstat *st);
+int			checkpoint (const char *file);
+int			restore (const char *file);
+#endif
 
 /* System call.
  *
@@ -74,6 +92,10 @@ void
 syscall_handler (struct intr_frame *f) {
 	// TODO: Your implementation goes here.
 	// printf("###\n");
+#ifdef VM
+	/* Faults on user memory below this rsp are not stack accesses. */
+	thread_current ()->user_rsp = f->rsp;
+#endif
 	switch (f->R.rax) {
 		case SYS_HALT:
 			halt();
@@ -93,6 +115,11 @@ syscall_handler (struct intr_frame *f) {
 		case SYS_WAIT:
 			f->R.rax = wait (f->R.rdi);
 			break;
+		case SYS_SPAWN:
+			user_address_check((uint64_t *) f->R.rdi);
+			f->R.rax = spawn ((const char *) f->R.rdi,
+					(const struct spawn_action *) f->R.rsi, f->R.rdx);
+			break;
 		case SYS_CREATE:
 			user_address_check(f->R.rdi);
 			f->R.rax =  create (f->R.rdi, f->R.rsi);
@@ -110,11 +137,26 @@ syscall_handler (struct intr_frame *f) {
 			break;
 		case SYS_READ:
 			user_address_check(f->R.rsi);
+#ifdef VM
+			/* Keep the buffer resident for the whole transfer. */
+			if (!vm_pin_buffer((void *) f->R.rsi, f->R.rdx, true))
+				exit(-1);
+#endif
 			f->R.rax = read (f->R.rdi, f->R.rsi, f->R.rdx);
+#ifdef VM
+			vm_unpin_buffer((void *) f->R.rsi, f->R.rdx);
+#endif
 			break;
 		case SYS_WRITE:
 			user_address_check(f->R.rsi);
+#ifdef VM
+			if (!vm_pin_buffer((void *) f->R.rsi, f->R.rdx, false))
+				exit(-1);
+#endif
 			f->R.rax = write (f->R.rdi, f->R.rsi, f->R.rdx);
+#ifdef VM
+			vm_unpin_buffer((void *) f->R.rsi, f->R.rdx);
+#endif
 			break;
 		case SYS_SEEK:
 			seek (f->R.rdi, f->R.rsi);
@@ -125,14 +167,41 @@ syscall_handler (struct intr_frame *f) {
 		case SYS_CLOSE:
 			close (f->R.rdi);
 			break;
+#ifdef VM
 		case SYS_MMAP:
-			user_address_check(f->R.rdi);
-				// mmap (f->R.rdi, f->R.rsi, f->R.rdx, f->R.r10, f->R.r8);
+			f->R.rax = (uint64_t) mmap ((void *) f->R.rdi, f->R.rsi, f->R.rdx,
+					f->R.r10, f->R.r8);
 			break;
 		case SYS_MUNMAP:
-			user_address_check(f->R.rdi);
-				// munmap (f->R.rdi);
+			munmap ((void *) f->R.rdi);
+			break;
+		case SYS_MEMSTAT:
+			user_address_check((uint64_t *) f->R.rsi);
+			f->R.rax = memstat (f->R.rdi, (struct memstat *) f->R.rsi);
+			break;
+		case SYS_SET_RSS_LIMIT:
+			f->R.rax = set_rss_limit (f->R.rdi, f->R.rsi);
+			break;
+		case SYS_MADVISE:
+			f->R.rax = madvise ((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+			break;
+		case SYS_MSYNC:
+			f->R.rax = msync ((void *) f->R.rdi, f->R.rsi, f->R.rdx);
 			break;
+		case SYS_FAULTSTAT:
+			user_address_check((uint64_t *) f->R.rdi);
+			f->R.rax = faultstat ((struct faultstat *) f->R.rdi);
+			break;
+		case SYS_CHECKPOINT:
+			user_address_check((uint64_t *) f->R.rdi);
+			memcpy(&thread_current()->intr_f, f, sizeof(struct intr_frame));
+			f->R.rax = checkpoint ((const char *) f->R.rdi);
+			break;
+		case SYS_RESTORE:
+			user_address_check((uint64_t *) f->R.rdi);
+			f->R.rax = restore ((const char *) f->R.rdi);
+			break;
+#endif
 		case SYS_CHDIR:
 			user_address_check(f->R.rdi);
 				// chdir (f->R.rdi);
@@ -161,8 +230,19 @@ syscall_handler (struct intr_frame *f) {
 
 
 void user_address_check (uint64_t *addr) {
+#ifdef VM
+	/* The page may not be loaded yet.  Accept anything the page fault
+	 * handler would resolve. */
+	struct thread	*cur = thread_current();
+
+	if (addr == NULL || is_kernel_vaddr(addr)
+			|| (spt_find_page(&cur->spt, addr) == NULL
+				&& !vm_is_stack_access(addr, cur->user_rsp)))
+		exit(-1);
+#else
 	if (is_kernel_vaddr(addr) || pml4_get_page(thread_current()->pml4, addr) == NULL) 
 		exit(-1);
+#endif
 }
 
 void halt (void)  {
@@ -272,13 +352,108 @@ unsigned	tell (int fd) {
 }
 
 pid_t	fork (const char *thread_name) {
-	return process_fork(thread_name, thread_current()->intr_f);
+	return process_fork(thread_name, &thread_current()->intr_f);
 }
 
 int		wait (pid_t pid) {
 	return process_wait (pid);
 }
 
+#ifdef VM
+void	*mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
+	struct thread	*cur = thread_current();
+
+	if (fd < 2 || fd >= 64 || cur->fd_t[fd] == NULL)
+		return NULL;
+	return do_mmap(addr, length, writable, cur->fd_t[fd], offset);
+}
+
+void	munmap (void *addr) {
+	do_munmap(addr);
+}
+
+/* Returns the process PID: the caller itself if PID is 0, or one of
+ * its children that it has not waited for. */
+static struct thread *
+get_process (pid_t pid) {
+	struct thread	*cur = thread_current();
+	struct list_elem *e;
+
+	if (pid == 0)
+		return cur;
+	for (e = list_begin(&cur->child_list); e != list_end(&cur->child_list); e = list_next(e)) {
+		struct thread *child = list_entry (e, struct thread, child_elem);
+		if (child->tid == pid)
+			return child;
+	}
+	return NULL;
+}
+
+bool	memstat (pid_t pid, struct memstat *st) {
+	struct thread	*t = get_process(pid);
+	struct memstat	m;
+
+	if (t == NULL)
+		return false;
+	m.rss = t->spt.rss;
+	m.wss = wss_estimate(t);
+	m.rss_limit = t->rss_limit;
+
+	if (!vm_pin_buffer(st, sizeof *st, true))
+		exit(-1);
+	memcpy(st, &m, sizeof m);
+	vm_unpin_buffer(st, sizeof *st);
+	return true;
+}
+
+bool	set_rss_limit (pid_t pid, size_t pages) {
+	struct thread	*t = get_process(pid);
+
+	if (t == NULL)
+		return false;
+	t->rss_limit = pages;
+	return true;
+}
+
+bool	madvise (void *addr, size_t length, int advice) {
+	return do_madvise(addr, length, advice);
+}
+
+bool	msync (void *addr, size_t length, int flags) {
+	return do_msync(addr, length, flags);
+}
+
+bool	faultstat (struct faultstat *st) {
+	if (!vm_pin_buffer(st, sizeof *st, true))
+		exit(-1);
+	vm_get_fault_stat(st);
+	vm_unpin_buffer(st, sizeof *st);
+	return true;
+}
+
+int	checkpoint (const char *file) {
+	char	*file_cp = palloc_get_page (PAL_ZERO);
+	int		ret;
+
+	if (file_cp == NULL)
+		return -1;
+	strlcpy (file_cp, file, PGSIZE);
+	ret = process_checkpoint (file_cp);
+	palloc_free_page (file_cp);
+	return ret;
+}
+
+int	restore (const char *file) {
+	char	*file_cp = palloc_get_page (PAL_ZERO);
+
+	/* Returns only if the running process is left as it was. */
+	if (file_cp == NULL)
+		return -1;
+	strlcpy (file_cp, file, PGSIZE);
+	return process_restore (file_cp);
+}
+#endif
+
 int	exec (const char *cmd_line) {
 	char *cmd_cp = palloc_get_page (PAL_ZERO);
 	if (cmd_cp == NULL)
@@ -290,3 +465,34 @@ int	exec (const char *cmd_line) {
 	}
 	NOT_REACHED ();
 }
+
+pid_t	spawn (const char *cmd_line, const struct spawn_action *actions,
+		size_t action_cnt) {
+	struct spawn_action	acts[SPAWN_ACTIONS_MAX];
+	char				*cmd_cp;
+	pid_t				pid;
+
+	if (action_cnt > SPAWN_ACTIONS_MAX)
+		return PID_ERROR;
+	if (action_cnt > 0) {
+		user_address_check((uint64_t *) actions);
+		user_address_check((uint64_t *) ((uint8_t *) (actions + action_cnt) - 1));
+#ifdef VM
+		if (!vm_pin_buffer((void *) actions, action_cnt * sizeof *actions,
+					false))
+			exit(-1);
+#endif
+		memcpy(acts, actions, action_cnt * sizeof *actions);
+#ifdef VM
+		vm_unpin_buffer((void *) actions, action_cnt * sizeof *actions);
+#endif
+	}
+
+	cmd_cp = palloc_get_page (PAL_ZERO);
+	if (cmd_cp == NULL)
+		return PID_ERROR;
+	strlcpy (cmd_cp, cmd_line, PGSIZE);
+	pid = process_spawn (cmd_cp, acts, action_cnt);
+	palloc_free_page (cmd_cp);
+	return pid;
+}
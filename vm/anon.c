@@ -1,14 +1,43 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <bitmap.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
 #include "vm/vm.h"
+#include "vm/zswap.h"
 #include "devices/disk.h"
 
+/* A swap slot holds one page. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Most pages written out or read ahead by one disk command. */
+#define SWAP_CLUSTER 8
+
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
 static bool anon_swap_in (struct page *page, void *kva);
 static bool anon_swap_out (struct page *page);
 static void anon_destroy (struct page *page);
 
+static struct bitmap *swap_table;   /* Slots in use. */
+static uint16_t *swap_refs;         /* Pages sharing each slot in use. */
+static size_t swap_used;            /* Number of slots in use. */
+static struct lock swap_lock;       /* Protects the three above. */
+
+/* Swap I/O statistics.  Protected by vm_lock, which every swap_in()
+ * and swap_out() runs under.  Pages the compressed cache takes or
+ * supplies are not counted as written or read. */
+static long long swap_out_pages;    /* Pages written to swap. */
+static long long swap_out_cmds;     /* Disk commands writing them. */
+static long long swap_in_pages;     /* Pages read from swap. */
+static long long swap_in_cmds;      /* Disk commands reading them. */
+static long long swap_ra_pages;     /* Pages read ahead. */
+
 /* DO NOT MODIFY this struct */
 static const struct page_operations anon_ops = {
 	.swap_in = anon_swap_in,
@@ -20,33 +49,381 @@ static const struct page_operations anon_ops = {
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	size_t slot_cnt = 0;
+
+	swap_disk = disk_get (1, 1);
+	if (swap_disk != NULL)
+		slot_cnt = disk_size (swap_disk) / SECTORS_PER_SLOT;
+	swap_table = bitmap_create (slot_cnt);
+	swap_refs = calloc (slot_cnt + 1, sizeof *swap_refs);
+	if (swap_table == NULL || swap_refs == NULL)
+		PANIC ("vm_anon_init: cannot allocate swap table");
+	swap_used = 0;
+	lock_init (&swap_lock);
+	zswap_init (swap_disk);
+}
+
+/* Prints swap I/O statistics. */
+void
+vm_anon_print_stats (void) {
+	printf ("Swap: %lld pages out in %lld writes, "
+			"%lld pages in in %lld reads (%lld read ahead)\n",
+			swap_out_pages, swap_out_cmds,
+			swap_in_pages, swap_in_cmds, swap_ra_pages);
+	zswap_print_stats ();
+}
+
+/* Allocates up to *CNT consecutive free swap slots, preferring the
+ * run that starts at HINT, and returns the first.  Asks for shorter
+ * runs if no run of *CNT slots is free, and stores the length it got
+ * in *CNT.  Returns SWAP_SLOT_NONE if swap is full. */
+static size_t
+swap_alloc (size_t hint, size_t *cnt) {
+	size_t slot = SWAP_SLOT_NONE;
+
+	lock_acquire (&swap_lock);
+	for (; *cnt > 0; *cnt /= 2) {
+		if (hint != SWAP_SLOT_NONE && hint + *cnt <= bitmap_size (swap_table)
+				&& bitmap_none (swap_table, hint, *cnt)) {
+			bitmap_set_multiple (swap_table, hint, *cnt, true);
+			slot = hint;
+		} else
+			slot = bitmap_scan_and_flip (swap_table, 0, *cnt, false);
+		if (slot != SWAP_SLOT_NONE) {
+			size_t i;
+
+			for (i = 0; i < *cnt; i++)
+				swap_refs[slot + i] = 1;
+			swap_used += *cnt;
+			break;
+		}
+	}
+	lock_release (&swap_lock);
+	return slot;
+}
+
+/* Drops a reference to SLOT, releasing it once no page shares it. */
+static void
+swap_free (size_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_table, slot));
+	ASSERT (swap_refs[slot] > 0);
+	if (--swap_refs[slot] == 0) {
+		zswap_invalidate (slot);
+		bitmap_reset (swap_table, slot);
+		swap_used--;
+	}
+	lock_release (&swap_lock);
+}
+
+/* Adds a reference to SLOT, which is in use. */
+static void
+swap_dup (size_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_table, slot));
+	ASSERT (swap_refs[slot] < UINT16_MAX);
+	swap_refs[slot]++;
+	lock_release (&swap_lock);
+}
+
+/* Returns true if some other page shares SLOT. */
+static bool
+swap_is_shared (size_t slot) {
+	return swap_refs[slot] > 1;
+}
+
+/* Returns true if more than half of swap is in use, in which case
+ * slots are not kept for pages that are resident. */
+static bool
+swap_is_tight (void) {
+	return swap_used * 2 > bitmap_size (swap_table);
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED, void *kva) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
+	page->anon.slot = SWAP_SLOT_NONE;
 
-	struct anon_page *anon_page = &page->anon;
+	/* Anonymous memory starts out zeroed; lazy loaders overwrite it. */
+	memset (kva, 0, PGSIZE);
+	return true;
+}
+
+/* Returns the page of PAGE's owner I pages above PAGE if it is an
+ * anonymous page, or a null pointer. */
+static struct page *
+anon_neighbor (struct page *page, int i) {
+	uintptr_t va = (uintptr_t) page->va + (intptr_t) i * PGSIZE;
+	struct page *neighbor;
+
+	if (i < 0 ? va > (uintptr_t) page->va : !is_user_vaddr (va))
+		return NULL;
+	neighbor = spt_find_page (&page->owner->spt, (void *) va);
+	if (neighbor == NULL || neighbor->operations != &anon_ops)
+		return NULL;
+	return neighbor;
 }
 
-/* Swap in the page by read contents from the swap disk. */
+/* Reads the CNT consecutive slots starting at SLOT into the frames
+ * KVAS with one disk command, falling back to one command per page
+ * if they cannot be mapped side by side. */
+static void
+swap_read_disk (size_t slot, void **kvas, size_t cnt) {
+	void *area = cnt > 1 ? vmap (kvas, cnt) : kvas[0];
+	size_t i;
+
+	if (area != NULL) {
+		disk_read_multiple (swap_disk, slot * SECTORS_PER_SLOT, area,
+				cnt * SECTORS_PER_SLOT);
+		swap_in_cmds++;
+		if (cnt > 1)
+			vunmap (area);
+	} else
+		for (i = 0; i < cnt; i++) {
+			disk_read_multiple (swap_disk, (slot + i) * SECTORS_PER_SLOT,
+					kvas[i], SECTORS_PER_SLOT);
+			swap_in_cmds++;
+		}
+	swap_in_pages += cnt;
+}
+
+/* Writes the frames KVAS to the CNT consecutive slots starting at
+ * SLOT, like swap_read_disk(). */
+static void
+swap_write_disk (size_t slot, void **kvas, size_t cnt) {
+	void *area = cnt > 1 ? vmap (kvas, cnt) : kvas[0];
+	size_t i;
+
+	if (area != NULL) {
+		disk_write_multiple (swap_disk, slot * SECTORS_PER_SLOT, area,
+				cnt * SECTORS_PER_SLOT);
+		swap_out_cmds++;
+		if (cnt > 1)
+			vunmap (area);
+	} else
+		for (i = 0; i < cnt; i++) {
+			disk_write_multiple (swap_disk, (slot + i) * SECTORS_PER_SLOT,
+					kvas[i], SECTORS_PER_SLOT);
+			swap_out_cmds++;
+		}
+	swap_out_pages += cnt;
+}
+
+/* Reads the CNT consecutive slots starting at SLOT into the frames
+ * KVAS, from the compressed cache where it has them and from disk, as
+ * few commands as possible, where it does not. */
+static void
+swap_read (size_t slot, void **kvas, size_t cnt) {
+	size_t i, run;
+
+	for (i = 0; i < cnt; i += run + 1) {
+		for (run = 0; i + run < cnt; run++)
+			if (zswap_load (slot + i + run, kvas[i + run]))
+				break;
+		if (run > 0)
+			swap_read_disk (slot + i, kvas + i, run);
+	}
+}
+
+/* Writes the frames KVAS to the CNT consecutive slots starting at
+ * SLOT, into the compressed cache where they fit and to disk
+ * otherwise, like swap_read(). */
+static void
+swap_write (size_t slot, void **kvas, size_t cnt) {
+	size_t i, run;
+
+	for (i = 0; i < cnt; i += run + 1) {
+		for (run = 0; i + run < cnt; run++)
+			if (zswap_store (slot + i + run, kvas[i + run]))
+				break;
+		if (run > 0)
+			swap_write_disk (slot + i, kvas + i, run);
+	}
+}
+
+/* Swap in the page by read contents from the swap disk.
+ *
+ * Clustered swap-out gives pages that are adjacent in the address
+ * space adjacent slots, so the pages following PAGE are likely to
+ * follow it on disk as well.  Those that are swapped out there are
+ * read with the same command into free frames, as long as free
+ * frames are at hand, and mapped clean so that evicting them unused
+ * costs nothing. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+	struct page *pages[SWAP_CLUSTER];
+	void *kvas[SWAP_CLUSTER];
+	size_t cnt = 1;
+	size_t i;
+
+	ASSERT (anon_page->slot != SWAP_SLOT_NONE);
+
+	pages[0] = page;
+	kvas[0] = kva;
+	/* Speculative reads would only add to the pressure on swap. */
+	while (cnt < SWAP_CLUSTER && page->advice != MADV_RANDOM
+			&& !swap_is_tight ()) {
+		struct page *next = anon_neighbor (page, cnt);
+		struct frame *frame;
+
+		if (next == NULL || next->frame != NULL
+				|| next->anon.slot != anon_page->slot + cnt
+				|| vm_rss_at_limit (page->owner))
+			break;
+		frame = vm_get_free_frame ();
+		if (frame == NULL)
+			break;
+		vm_frame_link (frame, next);
+		pages[cnt] = next;
+		kvas[cnt++] = frame->kva;
+	}
+	swap_read (anon_page->slot, kvas, cnt);
+	swap_ra_pages += cnt - 1;
+
+	for (i = 1; i < cnt; i++)
+		if (!pml4_set_page (page->owner->pml4, pages[i]->va, kvas[i],
+					pages[i]->writable))
+			vm_free_frame (pages[i]);
+
+	/* Keep the slot: as long as the page stays clean, evicting it again
+	 * needs no write. */
+	if (swap_is_tight ()) {
+		swap_free (anon_page->slot);
+		anon_page->slot = SWAP_SLOT_NONE;
+	}
+	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Returns true if swapping PAGE out requires writing it. */
+static bool
+anon_needs_write (struct page *page) {
+	return page->anon.slot == SWAP_SLOT_NONE
+		|| pml4_is_dirty (page->owner->pml4, page->va);
+}
+
+/* Swap out the page by writing contents to the swap disk.
+ *
+ * Dirty pages are written in clusters: the resident, unpinned,
+ * unreferenced pages that directly follow PAGE in its owner's address
+ * space and need writing too are evicted along with it, into
+ * consecutive slots and with a single disk command.  A page written
+ * alone is put right after the slot of the page below it, if that is
+ * free, so the address space stays laid out in order on disk. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	uint64_t *pml4 = page->owner->pml4;
+	struct page *pages[SWAP_CLUSTER];
+	void *kvas[SWAP_CLUSTER];
+	size_t slot = SWAP_SLOT_NONE;
+	size_t cnt = 1;
+	size_t i;
+
+	if (!anon_needs_write (page))
+		return true;
+
+	pages[0] = page;
+	while (cnt < SWAP_CLUSTER) {
+		struct page *next = anon_neighbor (page, cnt);
+
+		if (next == NULL || next->frame == NULL || next->frame->pin_cnt > 0
+				|| next->frame->ref_cnt > 1 || pml4_is_accessed (pml4, next->va)
+				|| next->referenced || !anon_needs_write (next))
+			break;
+		pages[cnt++] = next;
+	}
+
+	if (cnt > 1 || page->anon.slot == SWAP_SLOT_NONE
+			|| swap_is_shared (page->anon.slot)) {
+		struct page *prev = anon_neighbor (page, -1);
+		size_t hint = SWAP_SLOT_NONE;
+
+		if (prev != NULL && prev->anon.slot != SWAP_SLOT_NONE)
+			hint = prev->anon.slot + 1;
+		slot = swap_alloc (hint, &cnt);
+	}
+	if (slot == SWAP_SLOT_NONE) {
+		/* Write PAGE alone, back to the slot it already has. */
+		if (page->anon.slot == SWAP_SLOT_NONE
+				|| swap_is_shared (page->anon.slot))
+			return false;
+		slot = page->anon.slot;
+		cnt = 1;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		/* Unmap the neighbors before writing, as vm_evict_frame() did
+		 * PAGE. */
+		if (i > 0)
+			pml4_clear_page (pml4, pages[i]->va);
+		if (pages[i]->anon.slot != slot + i) {
+			if (pages[i]->anon.slot != SWAP_SLOT_NONE)
+				swap_free (pages[i]->anon.slot);
+			pages[i]->anon.slot = slot + i;
+		}
+		kvas[i] = pages[i]->frame->kva;
+	}
+	swap_write (slot, kvas, cnt);
+
+	for (i = 1; i < cnt; i++)
+		vm_free_frame (pages[i]);
+	return true;
+}
+
+/* Makes anonymous page DST, whose contents are the same as SRC's, share
+ * SRC's swap slot as well.  A resident SRC that was modified since it
+ * was last written out first gives up its out-of-date slot. */
+void
+anon_share (struct page *dst, struct page *src) {
+	size_t slot = src->anon.slot;
+
+	if (slot != SWAP_SLOT_NONE && src->frame != NULL
+			&& pml4_is_dirty (src->owner->pml4, src->va)) {
+		swap_free (slot);
+		src->anon.slot = slot = SWAP_SLOT_NONE;
+	}
+	if (dst->anon.slot == slot)
+		return;
+	if (dst->anon.slot != SWAP_SLOT_NONE)
+		swap_free (dst->anon.slot);
+	dst->anon.slot = slot;
+	if (slot != SWAP_SLOT_NONE)
+		swap_dup (slot);
+}
+
+/* Turns PAGE, which is resident and not shared, into an anonymous page
+ * holding what its frame holds: a page of a private file mapping, on its
+ * first write.  Must hold vm_lock. */
+void
+anon_adopt (struct page *page) {
+	page->operations = &anon_ops;
+	page->anon.slot = SWAP_SLOT_NONE;
+}
+
+/* Drops the contents of PAGE, for MADV_DONTNEED: it gives up its frame
+ * and swap slot and reads back as zeros, like a page never touched.
+ * Must hold vm_lock. */
+void
+anon_discard (struct page *page) {
+	struct thread *owner = page->owner;
+	bool writable = page->writable;
+	uint8_t advice = page->advice;
+
+	anon_destroy (page);
+	uninit_new (page, page->va, NULL, VM_ANON, NULL, anon_initializer);
+	page->writable = writable;
+	page->owner = owner;
+	page->advice = advice;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->slot != SWAP_SLOT_NONE)
+		swap_free (anon_page->slot);
+	vm_free_frame (page);
 }
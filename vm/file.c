@@ -1,10 +1,52 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/text.h"
 #include "vm/vm.h"
 
+/* Most pages written back by one file write. */
+#define WRITEBACK_MAX 32
+
+/* Most pages copied for the flusher at a time.  Past that, msync
+ * (MS_ASYNC) writes runs itself rather than hold more memory. */
+#define FLUSH_MAX 512
+
+/* A run of mapped pages copied by msync (MS_ASYNC), waiting for the
+ * flusher to write it to the file. */
+struct flush_request {
+	struct list_elem elem;      /* flush_queue. */
+	struct file *file;          /* Reopened, owned by the request. */
+	off_t offset;               /* Where in FILE the run goes. */
+	size_t size;                /* Bytes to write. */
+	size_t page_cnt;            /* Pages in PAGES. */
+	void *pages[WRITEBACK_MAX]; /* Copies of the run's pages. */
+};
+
+static struct list flush_queue;         /* Requests not yet taken. */
+static struct lock flush_lock;          /* Protects the flush state. */
+static struct condition flush_idle;     /* Signaled when none pending. */
+static struct semaphore flush_sema;     /* Upped once per request. */
+static size_t flush_pending;            /* Queued or being written. */
+static size_t flush_pending_pages;      /* Pages in them. */
+
+static long long writeback_page_cnt;    /* Pages written back. */
+static long long writeback_cnt;         /* Writes that did it. */
+static long long flush_page_cnt;        /* Pages written by the flusher. */
+static long long flush_cnt;             /* Writes that did it. */
+
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
 static void file_backed_destroy (struct page *page);
+static void flush_wait (void);
+static void flusher (void *aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations file_ops = {
@@ -14,45 +56,619 @@ static const struct page_operations file_ops = {
 	.type = VM_FILE,
 };
 
-/* The initializer of file vm */
+/* The initializer of file vm.  Starts the flusher, which writes what
+ * msync (MS_ASYNC) leaves behind. */
 void
 vm_file_init (void) {
+	list_init (&flush_queue);
+	lock_init (&flush_lock);
+	cond_init (&flush_idle);
+	sema_init (&flush_sema, 0);
+	if (thread_create ("flusher", PRI_DEFAULT, flusher, NULL) == TID_ERROR)
+		PANIC ("vm_file_init: cannot start flusher");
+}
+
+/* Prints writeback statistics for mapped files. */
+void
+vm_file_print_stats (void) {
+	printf ("Mapped files: %lld pages written back in %lld writes, "
+			"%lld in %lld by the flusher\n", writeback_page_cnt, writeback_cnt,
+			flush_page_cnt, flush_cnt);
 }
 
 /* Initialize the file backed page */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &file_ops;
 
-	struct file_page *file_page = &page->file;
+	/* The region is bound by lazy_load_file(). */
+	page->file.region = NULL;
+	page->file.private = (type & VM_PRIVATE) != 0;
+	return true;
+}
+
+/* Returns the offset of PAGE within its mapping and stores the number
+ * of bytes of it that are backed by the file in *READ_BYTES. */
+static size_t
+file_page_ofs (struct page *page, size_t *read_bytes) {
+	struct mmap_region *region = page->file.region;
+	size_t ofs = (uint8_t *) page->va - (uint8_t *) region->addr;
+
+	*read_bytes = ofs < region->length ? region->length - ofs : 0;
+	if (*read_bytes > PGSIZE)
+		*read_bytes = PGSIZE;
+	return ofs;
+}
+
+/* Returns the mapping that PAGE, which may still be uninitialized,
+ * belongs to, or a null pointer if it is not part of a mapping. */
+static struct mmap_region *
+page_region (struct page *page) {
+	if (page == NULL)
+		return NULL;
+	if (page->operations == &file_ops)
+		return page->file.region;
+	if (VM_TYPE (page->operations->type) == VM_UNINIT
+			&& VM_TYPE (page->uninit.type) == VM_FILE)
+		return page->uninit.aux;
+	return NULL;
 }
 
-/* Swap in the page by read contents from the file. */
+/* Swap in the page by read contents from the file.
+ *
+ * Fault-around: the pages of the mapping that follow PAGE and are not
+ * resident, up to vm_fault_around_window() of them, are read along with
+ * it by one file read, as long as free frames are at hand.
+ *
+ * A page of a private mapping shares the frame of another private
+ * mapping of the same file page instead, if there is one, and whole
+ * pages read for it are offered to the others. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct mmap_region *region = page->file.region;
+	struct page *pages[FAULT_AROUND_MAX];
+	void *kvas[FAULT_AROUND_MAX + 1];
+	size_t read_bytes, size, tail;
+	size_t ofs = file_page_ofs (page, &read_bytes);
+	size_t window = vm_fault_around_window (page);
+	size_t cnt = 0;
+	size_t i;
+
+	/* The file may not have the latest contents yet. */
+	flush_wait ();
+
+	if (region->image != NULL
+			&& text_share (region->image, region->offset + ofs, page))
+		return true;
+
+	while (cnt < window
+			&& ofs + (cnt + 1) * PGSIZE < region->length) {
+		void *va = (uint8_t *) page->va + (cnt + 1) * PGSIZE;
+		struct page *next = spt_find_page (&page->owner->spt, va);
+
+		if (next == NULL || next->frame != NULL || page_region (next) != region)
+			break;
+		if (region->image != NULL && text_find (region->image,
+					region->offset + ofs + (cnt + 1) * PGSIZE) != NULL)
+			break;
+		pages[cnt++] = next;
+	}
+	cnt = vm_fault_around_prepare (pages, cnt);
+
+	kvas[0] = kva;
+	for (i = 0; i < cnt; i++) {
+		pages[i]->file.region = region;
+		kvas[i + 1] = pages[i]->frame->kva;
+	}
+	/* Every page but PAGE itself holds file data, so only the last one
+	 * can extend past the end of the file. */
+	size = read_bytes + cnt * PGSIZE;
+	if (size > region->length - ofs)
+		size = region->length - ofs;
+	if (!vm_read_frames (region->file, region->offset + ofs, kvas, cnt + 1,
+				size))
+		return false;
+	tail = (cnt + 1) * PGSIZE - size;
+	memset ((uint8_t *) kvas[cnt] + PGSIZE - tail, 0, tail);
+
+	if (region->image != NULL)
+		for (i = 0; i <= cnt && (i + 1) * PGSIZE <= size; i++)
+			text_add (region->image, region->offset + ofs + i * PGSIZE,
+					i == 0 ? page->frame : pages[i - 1]->frame);
+	return true;
+}
+
+/* Waits until the flusher has written everything queued, so that a
+ * write or read of a file cannot race with an older copy of its pages
+ * still on the way. */
+static void
+flush_wait (void) {
+	lock_acquire (&flush_lock);
+	while (flush_pending > 0)
+		cond_wait (&flush_idle, &flush_lock);
+	lock_release (&flush_lock);
+}
+
+/* The flusher.  Writes the runs queued by queue_run(), in order. */
+static void
+flusher (void *aux UNUSED) {
+	for (;;) {
+		struct flush_request *req;
+		size_t i;
+
+		sema_down (&flush_sema);
+		lock_acquire (&flush_lock);
+		req = list_entry (list_pop_front (&flush_queue),
+				struct flush_request, elem);
+		lock_release (&flush_lock);
+
+		vm_write_frames (req->file, req->offset, req->pages, req->page_cnt,
+				req->size);
+		for (i = 0; i < req->page_cnt; i++)
+			palloc_free_page (req->pages[i]);
+		file_close (req->file);
+
+		lock_acquire (&flush_lock);
+		flush_page_cnt += req->page_cnt;
+		flush_cnt++;
+		flush_pending_pages -= req->page_cnt;
+		if (--flush_pending == 0)
+			cond_broadcast (&flush_idle, &flush_lock);
+		lock_release (&flush_lock);
+		free (req);
+	}
+}
+
+/* Returns true if PAGE is a loaded page of REGION, with data from the
+ * file, that the user modified since it was last written back. */
+static bool
+page_is_dirty (struct page *page, struct mmap_region *region) {
+	uint64_t *pml4;
+	size_t read_bytes;
+
+	if (page == NULL || page->operations != &file_ops
+			|| page->file.region != region || page->frame == NULL
+			|| page->file.private)
+		return false;
+	pml4 = page->owner->pml4;
+	file_page_ofs (page, &read_bytes);
+	return pml4 != NULL && read_bytes > 0 && pml4_is_dirty (pml4, page->va);
+}
+
+/* Collects into PAGES the run of dirty pages of PAGE's mapping that
+ * starts at PAGE, which must be dirty, and stops before END or after
+ * WRITEBACK_MAX pages.  Marks them clean, since the caller writes them
+ * out, and returns their number.  Stores the number of bytes of the run
+ * backed by the file in *SIZE. */
+static size_t
+collect_run (struct page *page, void *end, struct page **pages,
+		size_t *size) {
+	struct mmap_region *region = page->file.region;
+	struct supplemental_page_table *spt = &page->owner->spt;
+	size_t read_bytes;
+	size_t ofs = file_page_ofs (page, &read_bytes);
+	size_t cnt = 0;
+
+	ASSERT (page_is_dirty (page, region));
+
+	do {
+		void *va = (uint8_t *) page->va + PGSIZE;
+
+		pml4_set_dirty (page->owner->pml4, page->va, false);
+		pages[cnt++] = page;
+		page = (uint8_t *) va < (uint8_t *) end ? spt_find_page (spt, va) : NULL;
+	} while (cnt < WRITEBACK_MAX && page_is_dirty (page, region));
+
+	*size = cnt * PGSIZE;
+	if (*size > region->length - ofs)
+		*size = region->length - ofs;
+	return cnt;
+}
+
+/* Writes the CNT pages of a run collected by collect_run(), SIZE bytes
+ * of it, to their file with one write. */
+static void
+write_run (struct page **pages, size_t cnt, size_t size) {
+	struct mmap_region *region = pages[0]->file.region;
+	void *kvas[WRITEBACK_MAX];
+	size_t read_bytes;
+	size_t ofs = file_page_ofs (pages[0], &read_bytes);
+	size_t i;
+
+	for (i = 0; i < cnt; i++)
+		kvas[i] = pages[i]->frame->kva;
+	flush_wait ();
+	vm_write_frames (region->file, region->offset + ofs, kvas, cnt, size);
+	writeback_page_cnt += cnt;
+	writeback_cnt++;
+}
+
+/* Writes back the run of dirty pages that starts at PAGE and stops
+ * before END.  Returns the number of pages in the run. */
+static size_t
+writeback_run (struct page *page, void *end) {
+	struct page *pages[WRITEBACK_MAX];
+	size_t size;
+	size_t cnt = collect_run (page, end, pages, &size);
+
+	write_run (pages, cnt, size);
+	return cnt;
+}
+
+/* Like writeback_run(), but only copies the run and leaves the write to
+ * the flusher.  Writes the run itself if it cannot get the memory, or
+ * if the flusher has FLUSH_MAX pages to write already. */
+static size_t
+queue_run (struct page *page, void *end) {
+	struct mmap_region *region = page->file.region;
+	struct page *pages[WRITEBACK_MAX];
+	struct flush_request *req;
+	size_t read_bytes, size, cnt, i;
+	bool full;
+
+	lock_acquire (&flush_lock);
+	full = flush_pending_pages + WRITEBACK_MAX > FLUSH_MAX;
+	lock_release (&flush_lock);
+	if (full)
+		return writeback_run (page, end);
+
+	req = malloc (sizeof *req);
+	if (req == NULL)
+		return writeback_run (page, end);
+	req->file = file_reopen (region->file);
+	if (req->file == NULL) {
+		free (req);
+		return writeback_run (page, end);
+	}
+	req->offset = region->offset + file_page_ofs (page, &read_bytes);
+
+	cnt = collect_run (page, end, pages, &size);
+	for (i = 0; i < cnt; i++) {
+		req->pages[i] = palloc_get_page (0);
+		if (req->pages[i] == NULL)
+			break;
+		memcpy (req->pages[i], pages[i]->frame->kva, PGSIZE);
+	}
+	if (i < cnt) {
+		while (i-- > 0)
+			palloc_free_page (req->pages[i]);
+		file_close (req->file);
+		free (req);
+		write_run (pages, cnt, size);
+		return cnt;
+	}
+	req->size = size;
+	req->page_cnt = cnt;
+
+	lock_acquire (&flush_lock);
+	list_push_back (&flush_queue, &req->elem);
+	flush_pending++;
+	flush_pending_pages += cnt;
+	lock_release (&flush_lock);
+	sema_up (&flush_sema);
+	return cnt;
+}
+
+/* Writes back the dirty pages of REGION in [LO, HI), a run at a time.
+ * SPT is the table that REGION belongs to. */
+static void
+writeback_range (struct supplemental_page_table *spt,
+		struct mmap_region *region, void *lo, void *hi) {
+	uint8_t *va = lo;
+
+	while (va < (uint8_t *) hi) {
+		struct page *page = spt_find_page (spt, va);
+
+		if (page_is_dirty (page, region))
+			va += writeback_run (page, hi) * PGSIZE;
+		else
+			va += PGSIZE;
+	}
+}
+
+/* Writes PAGE back to its file if the user modified it, along with the
+ * dirty pages around it, up to WRITEBACK_MAX pages in all, so that
+ * evicting or unmapping neighbouring pages costs one write. */
+static void
+file_page_writeback (struct page *page) {
+	struct mmap_region *region = page->file.region;
+	struct supplemental_page_table *spt = &page->owner->spt;
+	void *end = (uint8_t *) region->addr + region->page_cnt * PGSIZE;
+	struct page *first = page;
+	size_t back = 0;
+
+	if (!page_is_dirty (page, region))
+		return;
+	while (back < WRITEBACK_MAX / 2 && first->va != region->addr) {
+		struct page *prev = spt_find_page (spt, (uint8_t *) first->va - PGSIZE);
+
+		if (!page_is_dirty (prev, region))
+			break;
+		first = prev;
+		back++;
+	}
+	writeback_run (first, end);
 }
 
 /* Swap out the page by writeback contents to the file. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	file_page_writeback (page);
+	return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	file_page_writeback (page);
+	vm_free_frame (page);
+}
+
+/* Lazy loader for mapped pages.  AUX is the page's mmap_region. */
+static bool
+lazy_load_file (struct page *page, void *aux) {
+	page->file.region = aux;
+	return file_backed_swap_in (page, page->frame->kva);
 }
 
-/* Do the mmap */
+/* Adds pages for every page of REGION to the current process's table.
+ * Returns false, leaving pages already added in place, on failure. */
+static bool
+region_alloc_pages (struct mmap_region *region) {
+	size_t i;
+
+	for (i = 0; i < region->page_cnt; i++) {
+		void *upage = (uint8_t *) region->addr + i * PGSIZE;
+
+		/* fork() may have copied the written pages of a private
+		 * mapping already. */
+		if (spt_find_page (&thread_current ()->spt, upage) != NULL)
+			continue;
+		if (!vm_alloc_page_with_initializer (
+					VM_FILE | (region->private ? VM_PRIVATE : 0), upage,
+					region->writable, lazy_load_file, region))
+			return false;
+	}
+	return true;
+}
+
+/* spt_for_each_range() callback that removes a page of a mapping,
+ * writing it back first if needed. */
+static bool
+unmap_page (struct page *page, void *spt) {
+	spt_remove_page (spt, page);
+	return true;
+}
+
+/* Removes REGION and all of its pages from SPT. */
+static void
+unmap_region (struct supplemental_page_table *spt,
+		struct mmap_region *region) {
+	void *end = (uint8_t *) region->addr + region->page_cnt * PGSIZE;
+
+	vm_lock_acquire ();
+	writeback_range (spt, region, region->addr, end);
+	spt_for_each_range (spt, region->addr, end, unmap_page, spt);
+	vm_lock_release ();
+	list_remove (&region->elem);
+	text_close (region->image);
+	file_close (region->file);
+	free (region);
+}
+
+/* Do the mmap.  WRITABLE may have MAP_POPULATE or'd in, to load the
+ * whole mapping now, and MAP_PRIVATE, to keep writes from the file. */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct mmap_region *region;
+	off_t file_len;
+	size_t i;
+
+	if (addr == NULL || pg_ofs (addr) != 0 || length == 0
+			|| offset < 0 || offset % PGSIZE != 0)
+		return NULL;
+	if ((uint64_t) addr + length < (uint64_t) addr
+			|| is_kernel_vaddr (addr)
+			|| is_kernel_vaddr ((uint8_t *) addr + length - 1))
+		return NULL;
+
+	file_len = file_length (file);
+	if (file_len == 0)
+		return NULL;
+
+	region = malloc (sizeof *region);
+	if (region == NULL)
+		return NULL;
+	region->addr = addr;
+	region->page_cnt = pg_no (pg_round_up ((uint8_t *) addr + length))
+		- pg_no (addr);
+	region->offset = offset;
+	region->length = offset < file_len ? (size_t) (file_len - offset) : 0;
+	if (region->length > length)
+		region->length = length;
+	region->writable = (writable & ~(MAP_POPULATE | MAP_PRIVATE)) != 0;
+	region->private = (writable & MAP_PRIVATE) != 0;
+	region->image = NULL;
+
+	/* The mapping may not overlap any existing page. */
+	for (i = 0; i < region->page_cnt; i++)
+		if (spt_find_page (spt, (uint8_t *) addr + i * PGSIZE) != NULL) {
+			free (region);
+			return NULL;
+		}
+
+	region->file = file_reopen (file);
+	if (region->file == NULL) {
+		free (region);
+		return NULL;
+	}
+	if (region->private)
+		region->image = text_open_mapping (file_get_inode (region->file));
+	list_push_back (&spt->mmaps, &region->elem);
+
+	if (!region_alloc_pages (region)) {
+		unmap_region (spt, region);
+		return NULL;
+	}
+	if (writable & MAP_POPULATE)
+		vm_populate (addr, region->page_cnt * PGSIZE);
+	return addr;
 }
 
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct list_elem *e;
+
+	for (e = list_begin (&spt->mmaps); e != list_end (&spt->mmaps);
+			e = list_next (e)) {
+		struct mmap_region *region = list_entry (e, struct mmap_region, elem);
+
+		if (region->addr == addr) {
+			unmap_region (spt, region);
+			return;
+		}
+	}
+}
+
+/* Makes PAGE, a page of a private mapping that was written and so
+ * became anonymous, read back from the file again, for MADV_DONTNEED.
+ * Returns false, doing nothing, if PAGE is not part of a private
+ * mapping.  Must hold vm_lock. */
+bool
+file_private_discard (struct page *page) {
+	struct list *mmaps = &page->owner->spt.mmaps;
+	struct list_elem *e;
+
+	for (e = list_begin (mmaps); e != list_end (mmaps); e = list_next (e)) {
+		struct mmap_region *region = list_entry (e, struct mmap_region, elem);
+		uint8_t *end = (uint8_t *) region->addr + region->page_cnt * PGSIZE;
+
+		if ((uint8_t *) page->va < (uint8_t *) region->addr
+				|| (uint8_t *) page->va >= end)
+			continue;
+		if (!region->private)
+			return false;
+		anon_discard (page);
+		page->uninit.type = VM_FILE | VM_PRIVATE;
+		page->uninit.init = lazy_load_file;
+		page->uninit.aux = region;
+		page->uninit.page_initializer = file_backed_initializer;
+		return true;
+	}
+	return false;
+}
+
+/* Writes the modified pages of the mappings in [ADDR, ADDR + LENGTH)
+ * back to their files: before returning if FLAGS is MS_SYNC, or later,
+ * from copies made now, if it is MS_ASYNC.  Returns false if ADDR is
+ * not page-aligned, FLAGS is not valid, or the range holds pages that
+ * are not mapped.  Private mappings have nothing to write. */
+bool
+do_msync (void *addr, size_t length, int flags) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *end = (uint8_t *) addr + length;
+	uint8_t *va;
+
+	if (pg_ofs (addr) != 0 || (flags != MS_SYNC && flags != MS_ASYNC)
+			|| end < (uint8_t *) addr
+			|| (length > 0 && is_kernel_vaddr (end - 1)))
+		return false;
+	end = pg_round_up (end);
+	for (va = addr; va < end; va += PGSIZE)
+		if (spt_find_page (spt, va) == NULL)
+			return false;
+
+	vm_lock_acquire ();
+	for (va = addr; va < end; ) {
+		struct page *page = spt_find_page (spt, va);
+
+		if (!page_is_dirty (page, page_region (page)))
+			va += PGSIZE;
+		else if (flags == MS_SYNC)
+			va += writeback_run (page, end) * PGSIZE;
+		else
+			va += queue_run (page, end) * PGSIZE;
+	}
+	vm_lock_release ();
+
+	/* Runs queued by earlier calls are part of the range, too. */
+	if (flags == MS_SYNC)
+		flush_wait ();
+	return true;
+}
+
+/* Removes every mapping in SPT, writing modified pages back. */
+void
+do_munmap_all (struct supplemental_page_table *spt) {
+	while (!list_empty (&spt->mmaps))
+		unmap_region (spt, list_entry (list_front (&spt->mmaps),
+					struct mmap_region, elem));
+}
+
+/* Gives the running process, whose table is DST, the same mappings as
+ * SRC.  Pages the parent modified are copied so that the child sees
+ * modifications that are not yet written back; the rest stay lazy.
+ * Private mappings need no copying: their written pages are anonymous
+ * and shared copy-on-write already, and the rest read the file. */
+bool
+do_mmap_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct list_elem *e;
+
+	for (e = list_begin (&src->mmaps); e != list_end (&src->mmaps);
+			e = list_next (e)) {
+		struct mmap_region *parent = list_entry (e, struct mmap_region, elem);
+		struct mmap_region *region = malloc (sizeof *region);
+		size_t i;
+
+		if (region == NULL)
+			return false;
+		*region = *parent;
+		region->file = file_reopen (parent->file);
+		if (region->file == NULL) {
+			free (region);
+			return false;
+		}
+		if (region->private)
+			region->image = text_open_mapping (file_get_inode (region->file));
+		list_push_back (&dst->mmaps, &region->elem);
+		if (!region_alloc_pages (region))
+			return false;
+		if (region->private)
+			continue;
+
+		for (i = 0; i < region->page_cnt; i++) {
+			void *upage = (uint8_t *) region->addr + i * PGSIZE;
+			struct page *src_page = spt_find_page (src, upage);
+			struct page *page = spt_find_page (dst, upage);
+			bool success;
+
+			if (src_page == NULL || src_page->frame == NULL)
+				continue;
+			if (!vm_pin_page (src_page))
+				return false;
+			/* A clean page matches the file, which the child reads. */
+			if (!page_is_dirty (src_page, parent)) {
+				vm_unpin_page (src_page);
+				continue;
+			}
+			success = vm_pin_page (page);
+			if (success) {
+				memcpy (page->frame->kva, src_page->frame->kva, PGSIZE);
+				/* The copy may differ from the file; never drop it clean. */
+				pml4_set_dirty (thread_current ()->pml4, upage, true);
+				vm_unpin_page (page);
+			}
+			vm_unpin_page (src_page);
+			if (!success)
+				return false;
+		}
+	}
+	return true;
 }
@@ -0,0 +1,214 @@
+/* ksm.c: Same-page merging.
+ *
+ * A low-priority kernel thread walks the frame table, looking at
+ * ksm_pages_per_sec frames a second, for frames of anonymous pages that
+ * hold the same contents.  Each frame it looks at is checksummed.  A
+ * frame whose checksum did not change since the last pass is entered in
+ * a hash table by checksum, unless an entry with the same checksum is
+ * there already: then the two frames are compared byte for byte and, if
+ * they are the same, the pages of the new frame are moved over to the
+ * old one and the new frame is freed.  Every page of a merged frame is
+ * mapped read-only, so a write gets the page a private copy, as after
+ * fork.
+ *
+ * Frames that change between passes are never entered, so the table
+ * mostly holds frames that are not being written.  An entry that was
+ * written anyway fails the comparison and is dropped.  Evicting or
+ * freeing a frame removes it, through ksm_forget().  Everything here is
+ * protected by vm_lock. */
+
+#include "vm/ksm.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Times a second the daemon wakes up. */
+#define KSM_WAKEUPS 10
+
+unsigned ksm_pages_per_sec = 0;
+
+/* Frames that kept their contents over a pass, by checksum. */
+static struct hash frames;
+
+static long long scan_cnt;      /* Frames looked at. */
+static long long share_cnt;     /* Pages moved to a merged frame. */
+static long long save_cnt;      /* Frames freed by merging. */
+
+static hash_hash_func frame_hash;
+static hash_less_func frame_less;
+static void ksm_daemon (void *aux);
+
+/* Initializes same-page merging and starts the daemon, unless
+ * ksm_pages_per_sec is 0. */
+void
+ksm_init (void) {
+	if (!hash_init (&frames, frame_hash, frame_less, NULL))
+		PANIC ("ksm_init: cannot allocate hash table");
+	if (ksm_pages_per_sec > 0
+			&& thread_create ("ksm", PRI_MIN, ksm_daemon, NULL) == TID_ERROR)
+		PANIC ("ksm_init: cannot start daemon");
+}
+
+/* Prints same-page merging statistics. */
+void
+ksm_print_stats (void) {
+	printf ("Same-page merging: %lld frames scanned, %lld pages shared, "
+			"%lld frames saved\n", scan_cnt, share_cnt, save_cnt);
+}
+
+/* Returns the hash of frame E, its checksum. */
+static uint64_t
+frame_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_entry (e, struct frame, ksm_elem)->ksm_sum;
+}
+
+/* Orders frames A and B by checksum. */
+static bool
+frame_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct frame, ksm_elem)->ksm_sum
+		< hash_entry (b, struct frame, ksm_elem)->ksm_sum;
+}
+
+/* Removes FRAME, which is being evicted or freed, from the table. */
+void
+ksm_forget (struct frame *frame) {
+	if (frame->ksm_hashed) {
+		hash_delete (&frames, &frame->ksm_elem);
+		frame->ksm_hashed = false;
+	}
+}
+
+/* Returns true if FRAME holds an anonymous page that may be merged:
+ * one that no system call uses and that is not in the text cache. */
+static bool
+frame_is_mergeable (struct frame *frame) {
+	return frame->page != NULL && frame->pin_cnt == 0
+		&& frame->text_slot == NULL
+		&& VM_TYPE (frame->page->operations->type) == VM_ANON;
+}
+
+/* Maps every page sharing FRAME read-only, keeping the accessed and
+ * dirty bits, so that their owners cannot change FRAME behind our back:
+ * a write now faults and waits for vm_lock.  This thread runs on the
+ * kernel-only page table, so no stale TLB entry allows a write.
+ * Returns false if there was no memory for a page's PTE, when it lies
+ * in a large page or its page table was freed; the pages already
+ * protected just take a fault on their next write. */
+static bool
+frame_protect (struct frame *frame) {
+	struct page *page = frame->page;
+
+	do {
+		uint64_t *pml4 = page->owner->pml4;
+		bool accessed = pml4_is_accessed (pml4, page->va);
+		bool dirty = pml4_is_dirty (pml4, page->va);
+
+		if (!pml4_set_page (pml4, page->va, frame->kva, false))
+			return false;
+		pml4_set_accessed (pml4, page->va, accessed);
+		pml4_set_dirty (pml4, page->va, dirty);
+		page = page->share_next;
+	} while (page != frame->page);
+	return true;
+}
+
+/* Moves the pages sharing FRAME to INTO, which holds the same contents,
+ * mapping them read-only, and frees FRAME.  frame_protect() must have
+ * succeeded on FRAME, so that each page has a PTE of its own. */
+static void
+ksm_merge (struct frame *frame, struct frame *into) {
+	struct page *rep = into->page;
+	int cnt = frame->ref_cnt;
+	int i;
+
+	/* Drop REP's swap slot if it is out of date, so that the pages
+	 * moved over can share whatever slot it keeps. */
+	anon_share (rep, rep);
+
+	for (i = 0; i < cnt; i++) {
+		/* The last vm_free_frame() frees FRAME. */
+		struct page *page = frame->page;
+
+		vm_free_frame (page);
+		vm_frame_share (into, page);
+		anon_share (page, rep);
+		/* Only rewrites the PTE frame_protect() left, so it cannot
+		 * run out of memory. */
+		if (!pml4_set_page (page->owner->pml4, page->va, into->kva, false))
+			NOT_REACHED ();
+	}
+	share_cnt += cnt;
+	save_cnt++;
+}
+
+/* Looks at FRAME, merging it with an identical frame in the table or
+ * entering it in the table if its contents did not change since the
+ * last pass. */
+static void
+ksm_scan_frame (struct frame *frame) {
+	struct hash_elem *e;
+	uint64_t sum;
+
+	scan_cnt++;
+	ksm_forget (frame);
+	if (!frame_is_mergeable (frame))
+		return;
+
+	sum = hash_bytes (frame->kva, PGSIZE);
+	if (sum != frame->ksm_sum) {
+		/* Still changing; look again next pass. */
+		frame->ksm_sum = sum;
+		return;
+	}
+
+	while ((e = hash_find (&frames, &frame->ksm_elem)) != NULL) {
+		struct frame *match = hash_entry (e, struct frame, ksm_elem);
+
+		if (frame_is_mergeable (match)) {
+			/* Skip FRAME this pass if it cannot be protected. */
+			if (!frame_protect (frame))
+				return;
+			if (frame_protect (match)
+					&& !memcmp (frame->kva, match->kva, PGSIZE)) {
+				ksm_merge (frame, match);
+				return;
+			}
+		}
+		/* MATCH changed since it was entered, could not be protected,
+		 * or is a collision. */
+		ksm_forget (match);
+	}
+	hash_insert (&frames, &frame->ksm_elem);
+	frame->ksm_hashed = true;
+}
+
+/* The merging daemon.  Wakes up KSM_WAKEUPS times a second and scans
+ * its share of ksm_pages_per_sec frames, taking vm_lock for one frame
+ * at a time so that faults are not held up for long. */
+static void
+ksm_daemon (void *aux UNUSED) {
+	for (;;) {
+		unsigned batch = DIV_ROUND_UP (ksm_pages_per_sec, KSM_WAKEUPS);
+
+		while (batch-- > 0) {
+			struct frame *frame;
+
+			vm_lock_acquire ();
+			frame = vm_frame_scan ();
+			if (frame != NULL)
+				ksm_scan_frame (frame);
+			vm_lock_release ();
+			if (frame == NULL)
+				break;
+		}
+		timer_sleep (TIMER_FREQ / KSM_WAKEUPS);
+	}
+}
@@ -0,0 +1,111 @@
+/* kswapd.c: Background reclaim.
+ *
+ * Evicting a page in the thread that faults adds the eviction, and
+ * often a swap write, to the latency of the fault.  The kswapd thread
+ * evicts ahead of demand instead: it is woken once fewer than
+ * wmark_low frames are free in the user pool and evicts until
+ * wmark_high are.  Faults keep taking free frames as long as at least
+ * wmark_min are left, a reserve that carries them while kswapd catches
+ * up; below it they evict for themselves.  Speculative loads, such as
+ * fault-around and swap read-ahead, leave the frames below wmark_low
+ * alone.
+ *
+ * kswapd takes vm_lock for one eviction at a time, so faults are held
+ * up by at most the eviction in progress. */
+
+#include "vm/kswapd.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/vm.h"
+
+bool kswapd_enabled = true;
+
+/* Free frame watermarks, in pages. */
+static size_t wmark_min, wmark_low, wmark_high;
+
+static struct semaphore kswapd_sema;    /* Upped to wake kswapd. */
+static bool kswapd_awake;               /* Woken and not done yet? */
+
+/* Statistics.  Protected by vm_lock. */
+static long long wakeup_cnt;            /* Times kswapd was woken. */
+static long long reclaim_cnt;           /* Frames it evicted. */
+
+static void kswapd (void *aux);
+
+/* Sets the watermarks from the size of the user pool and starts
+ * kswapd, if kswapd_enabled. */
+void
+kswapd_init (void) {
+	if (!kswapd_enabled)
+		return;
+
+	wmark_min = DIV_ROUND_UP (palloc_pool_size (PAL_USER), 64);
+	wmark_low = 2 * wmark_min;
+	wmark_high = 3 * wmark_min;
+	sema_init (&kswapd_sema, 0);
+	if (thread_create ("kswapd", PRI_DEFAULT, kswapd, NULL) == TID_ERROR)
+		PANIC ("kswapd_init: cannot start kswapd");
+}
+
+/* Prints background reclaim statistics. */
+void
+kswapd_print_stats (void) {
+	if (kswapd_enabled)
+		printf ("kswapd: %lld wakeups, %lld frames reclaimed, "
+				"watermarks %zu/%zu/%zu\n", wakeup_cnt, reclaim_cnt,
+				wmark_min, wmark_low, wmark_high);
+	else
+		printf ("kswapd: disabled\n");
+}
+
+/* Returns true if a fault may take a free frame from the user pool, or
+ * false if it should evict one instead; a SPECULATIVE load should do
+ * without.  Wakes kswapd if free frames are running low.  Must hold
+ * vm_lock. */
+bool
+kswapd_may_allocate (bool speculative) {
+	size_t free_cnt = palloc_free_cnt (PAL_USER);
+
+	if (!kswapd_enabled)
+		return true;
+	if (free_cnt < wmark_low && !kswapd_awake) {
+		kswapd_awake = true;
+		wakeup_cnt++;
+		sema_up (&kswapd_sema);
+	}
+	return free_cnt >= (speculative ? wmark_low : wmark_min);
+}
+
+/* Like kswapd_may_allocate (true), for a load that takes CNT free
+ * frames at once: returns true only if wmark_low frames are still free
+ * after it, so that one load does not use up the reserve. */
+bool
+kswapd_may_allocate_run (size_t cnt) {
+	if (!kswapd_may_allocate (true))
+		return false;
+	return !kswapd_enabled || palloc_free_cnt (PAL_USER) >= wmark_low + cnt;
+}
+
+/* Evicts pages until wmark_high frames are free, whenever woken. */
+static void
+kswapd (void *aux UNUSED) {
+	for (;;) {
+		bool done = false;
+
+		sema_down (&kswapd_sema);
+		while (!done) {
+			vm_lock_acquire ();
+			done = palloc_free_cnt (PAL_USER) >= wmark_high
+				|| !vm_reclaim_frame ();
+			if (done)
+				kswapd_awake = false;
+			else
+				reclaim_cnt++;
+			vm_lock_release ();
+		}
+	}
+}
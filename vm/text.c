@@ -0,0 +1,263 @@
+/* text.c: Cache of executables that are being run.
+ *
+ * Writes to an executable are denied while a process runs it, so
+ * whatever is read from it stays valid for as long as some process
+ * does.  For each such executable this keeps the program headers that
+ * load() parsed, so that further processes need not read and check
+ * them again, and the frames that hold its read-only pages, so that
+ * further processes map the same frames instead of reading their own
+ * copies.
+ *
+ * Files mapped with MAP_PRIVATE are cached the same way, with no
+ * headers, so that private mappings of a file share frames until they
+ * are written.  Writes to such a file are not denied, so the frames of
+ * a mapped image are only trusted while the inode's version is the one
+ * they were read under; text_find() drops them all once it changes.
+ *
+ * A frame stays in the cache only while it holds the page: evicting
+ * or freeing it removes it, through text_forget().  Everything here is
+ * protected by vm_lock. */
+
+#include "vm/text.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+struct text_image {
+	struct list_elem elem;      /* Element in images. */
+	struct inode *inode;        /* The executable. */
+	int user_cnt;               /* Processes running it. */
+	void *headers;              /* Headers saved by load(). */
+	size_t page_cnt;            /* Pages in the executable. */
+	struct frame **frames;      /* Frame of each page, if cached. */
+	bool mapped;                /* Mapped file rather than executable? */
+	unsigned version;           /* Inode version the frames are from. */
+};
+
+static struct list images;
+
+static long long header_hits;   /* Loads that found their headers here. */
+static long long frame_hits;    /* Pages mapped to a cached frame. */
+
+/* Initializes the text cache. */
+void
+text_init (void) {
+	list_init (&images);
+}
+
+/* Prints text cache statistics. */
+void
+text_print_stats (void) {
+	printf ("Text cache: %lld headers reused, %lld pages shared\n",
+			header_hits, frame_hits);
+}
+
+/* Returns the cached image of INODE that is a mapped file if MAPPED is
+ * true or an executable otherwise, or a null pointer.  Must hold
+ * vm_lock. */
+static struct text_image *
+find_image (struct inode *inode, bool mapped) {
+	struct list_elem *e;
+
+	for (e = list_begin (&images); e != list_end (&images); e = list_next (e)) {
+		struct text_image *i = list_entry (e, struct text_image, elem);
+
+		if (i->inode == inode && i->mapped == mapped)
+			return i;
+	}
+	return NULL;
+}
+
+/* Returns a new image of INODE, FILE_LENGTH bytes long, with one user
+ * and no frames, or a null pointer if memory is short. */
+static struct text_image *
+image_create (struct inode *inode, off_t file_length, bool mapped) {
+	struct text_image *image = malloc (sizeof *image);
+
+	if (image == NULL)
+		return NULL;
+	image->inode = inode;
+	image->user_cnt = 1;
+	image->headers = NULL;
+	image->page_cnt = DIV_ROUND_UP (file_length, PGSIZE);
+	image->frames = calloc (image->page_cnt + 1, sizeof *image->frames);
+	image->mapped = mapped;
+	image->version = inode_version (inode);
+	if (image->frames == NULL) {
+		free (image);
+		return NULL;
+	}
+	return image;
+}
+
+/* Returns the cached image of the executable INODE and adds the
+ * running process to its users, or returns a null pointer if INODE is
+ * not cached. */
+struct text_image *
+text_open (struct inode *inode) {
+	struct text_image *image;
+
+	vm_lock_acquire ();
+	image = find_image (inode, false);
+	if (image != NULL) {
+		image->user_cnt++;
+		header_hits++;
+	}
+	vm_lock_release ();
+	return image;
+}
+
+/* Returns the image of INODE for a new private mapping of it, creating
+ * it if need be, with the mapping added to its users.  Returns a null
+ * pointer if memory is short; the mapping then shares nothing. */
+struct text_image *
+text_open_mapping (struct inode *inode) {
+	struct text_image *image;
+
+	vm_lock_acquire ();
+	image = find_image (inode, true);
+	if (image != NULL)
+		image->user_cnt++;
+	else {
+		image = image_create (inode, inode_length (inode), true);
+		if (image != NULL)
+			list_push_back (&images, &image->elem);
+	}
+	vm_lock_release ();
+	return image;
+}
+
+/* Caches the executable INODE, which is FILE_LENGTH bytes long and
+ * whose parsed headers are the SIZE bytes at HEADERS, with the running
+ * process as its only user.  The caller must have denied writes to
+ * INODE.  Returns a null pointer if memory is short. */
+struct text_image *
+text_create (struct inode *inode, const void *headers, size_t size,
+		off_t file_length) {
+	struct text_image *image = image_create (inode, file_length, false);
+
+	if (image == NULL)
+		return NULL;
+	image->headers = malloc (size);
+	if (image->headers == NULL) {
+		free (image->frames);
+		free (image);
+		return NULL;
+	}
+	memcpy (image->headers, headers, size);
+
+	vm_lock_acquire ();
+	list_push_back (&images, &image->elem);
+	vm_lock_release ();
+	return image;
+}
+
+/* Returns the headers saved with IMAGE. */
+const void *
+text_headers (const struct text_image *image) {
+	return image->headers;
+}
+
+/* Removes the running process from the users of IMAGE, which may be a
+ * null pointer, and drops IMAGE once it has none.  Must be called
+ * before the process allows writes to the executable again. */
+void
+text_close (struct text_image *image) {
+	size_t i;
+
+	if (image == NULL)
+		return;
+
+	vm_lock_acquire ();
+	if (--image->user_cnt > 0) {
+		vm_lock_release ();
+		return;
+	}
+	list_remove (&image->elem);
+	/* The frames live on as long as pages share them. */
+	for (i = 0; i < image->page_cnt; i++)
+		if (image->frames[i] != NULL)
+			image->frames[i]->text_slot = NULL;
+	vm_lock_release ();
+
+	free (image->frames);
+	free (image->headers);
+	free (image);
+}
+
+/* Drops every frame cached for IMAGE if its file was written since they
+ * were read. */
+static void
+image_validate (struct text_image *image) {
+	unsigned version = inode_version (image->inode);
+	size_t i;
+
+	if (image->version == version)
+		return;
+	for (i = 0; i < image->page_cnt; i++)
+		if (image->frames[i] != NULL) {
+			image->frames[i]->text_slot = NULL;
+			image->frames[i] = NULL;
+		}
+	image->version = version;
+}
+
+/* Returns the cached frame holding the page at OFS in IMAGE's
+ * executable, or a null pointer. */
+struct frame *
+text_find (struct text_image *image, off_t ofs) {
+	size_t idx = ofs / PGSIZE;
+
+	ASSERT (ofs % PGSIZE == 0);
+
+	image_validate (image);
+	if (idx >= image->page_cnt)
+		return NULL;
+	return image->frames[idx];
+}
+
+/* If a frame holding the page at OFS in IMAGE's executable is cached,
+ * makes PAGE, which is being loaded, share it instead of the frame it
+ * was given, and returns true.  The frame is mapped by the caller. */
+bool
+text_share (struct text_image *image, off_t ofs, struct page *page) {
+	struct frame *frame = text_find (image, ofs);
+
+	if (frame == NULL)
+		return false;
+	vm_free_frame (page);
+	vm_frame_share (frame, page);
+	frame_hits++;
+	return true;
+}
+
+/* Caches FRAME as holding the whole page at OFS in IMAGE's executable,
+ * unless another frame is cached for it already. */
+void
+text_add (struct text_image *image, off_t ofs, struct frame *frame) {
+	size_t idx = ofs / PGSIZE;
+
+	ASSERT (ofs % PGSIZE == 0);
+
+	if (idx >= image->page_cnt || image->frames[idx] != NULL
+			|| frame->text_slot != NULL
+			|| image->version != inode_version (image->inode))
+		return;
+	image->frames[idx] = frame;
+	frame->text_slot = &image->frames[idx];
+}
+
+/* Removes FRAME, which is being evicted or freed, from the cache. */
+void
+text_forget (struct frame *frame) {
+	if (frame->text_slot != NULL) {
+		*frame->text_slot = NULL;
+		frame->text_slot = NULL;
+	}
+}
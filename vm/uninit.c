@@ -8,6 +8,7 @@
  * function.
  * */
 
+#include "threads/malloc.h"
 #include "vm/vm.h"
 #include "vm/uninit.h"
 
@@ -56,13 +57,30 @@ uninit_initialize (struct page *page, void *kva) {
 		(init ? init (page, aux) : true);
 }
 
+/* Transmutes PAGE like its first fault does, except that the
+ * initialization callback is not run: the caller loads the contents
+ * into KVA itself, and takes over the AUX of PAGE. */
+bool
+uninit_transmute (struct page *page, void *kva) {
+	struct uninit_page *uninit = &page->uninit;
+
+	return uninit->page_initializer (page, uninit->type, kva);
+}
+
 /* Free the resources hold by uninit_page. Although most of pages are transmuted
  * to other page objects, it is possible to have uninit pages when the process
  * exit, which are never referenced during the execution.
  * PAGE will be freed by the caller. */
 static void
 uninit_destroy (struct page *page) {
-	struct uninit_page *uninit UNUSED = &page->uninit;
-	/* TODO: Fill this function.
-	 * TODO: If you don't have anything to do, just return. */
+	struct uninit_page *uninit = &page->uninit;
+
+	/* The AUX of an anonymous page belongs to the page and is normally
+	 * freed by its initializer.  File-backed pages borrow their mmap
+	 * region. */
+	if (VM_TYPE (uninit->type) == VM_ANON)
+		free (uninit->aux);
+
+	/* Zero-fill pages may be mapped to the zero frame. */
+	vm_free_frame (page);
 }
@@ -1,8 +1,112 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+#include "userprog/process.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/ksm.h"
+#include "vm/kswapd.h"
+#include "vm/text.h"
+#include "vm/wss.h"
+#include "intrinsic.h"
+
+/* How far below USER_STACK the stack may grow. */
+#define STACK_LIMIT (1 << 20)
+
+/* Shift of the virtual address bits that index each SPT level. */
+static const int spt_shift[SPT_LEVELS] = {
+	PML4SHIFT, PDPESHIFT, PDXSHIFT, PTXSHIFT
+};
+
+#define spt_index(va, level) \
+	(((uint64_t) (va) >> spt_shift[level]) & (SPT_FANOUT - 1))
+
+/* Frame table.  Every frame holding a user page is on FRAME_TABLE, in
+ * the order CLOCK_HAND sweeps them.  vm_lock protects the table and
+ * also serializes loading and evicting pages, so a page is never
+ * swapped in while its old contents are still being written out. */
+static struct list frame_table;
+static struct list_elem *clock_hand;
+static struct list_elem *scan_hand;     /* Where vm_frame_scan() is. */
+static struct lock vm_lock;
+
+enum evict_policy vm_evict_policy = EVICT_CLOCK;
+
+/* Number of pages following a faulting file-backed or executable page
+ * that the fault loads as well, at most FAULT_AROUND_MAX. */
+unsigned vm_fault_around = 8;
+
+/* Fault statistics.  Protected by vm_lock. */
+static long long fault_cnt;       /* Faults that loaded a page. */
+static long long around_cnt;      /* Pages loaded around them. */
+
+/* Copy-on-write statistics.  Protected by vm_lock. */
+static long long cow_share_cnt;   /* Frames shared by fork. */
+static long long cow_copy_cnt;    /* Frames copied on a write. */
+static long long private_cnt;     /* Private file pages written. */
+
+/* The zero frame.  A read fault on an anonymous page that starts out
+ * zeroed and was never written maps this one read-only frame instead
+ * of a private one; the page gets its own frame, still uninitialized
+ * until then, on its first write.  The frame is not in the frame table,
+ * so it is never evicted. */
+static struct frame zero_frame;
+static long long zero_map_cnt;    /* Read faults served by zero_frame. */
+static long long zero_copy_cnt;   /* Of those, later written. */
+
+/* Transparent huge pages.  A fault on a zero-fill page whose whole
+ * LARGE_PGSIZE aligned range consists of zero-fill pages maps the range
+ * at once with a large page, if an aligned run of free frames is at
+ * hand and taking it leaves wmark_low frames free.  Each page still
+ * gets a struct frame of its own: the large page is only a mapping,
+ * which the MMU splits into small pages as soon as one of them is
+ * remapped or unmapped, on copy-on-write, eviction or MADV_DONTNEED. */
+bool vm_thp = true;
+static long long thp_map_cnt;     /* Large pages mapped. */
+
+/* Frames taken from processes at their resident-set limit for their own
+ * faults.  Protected by vm_lock. */
+static long long rss_evict_cnt;
+
+/* Frames evicted by faulting threads themselves, because free frames
+ * ran out.  Protected by vm_lock. */
+static long long direct_evict_cnt;
+
+/* MADV_WILLNEED.  Ranges are handed to the willneed daemon, which reads
+ * their pages in while the process goes on.  Requests are only hints:
+ * when the queue is full they are dropped.  Protected by vm_lock. */
+#define WILLNEED_QUEUE_SIZE 16
+
+/* Request to read in the pages of OWNER in [ADDR, END). */
+struct willneed_request {
+	struct thread *owner;       /* Null once cancelled. */
+	uint8_t *addr;              /* Next page to look at. */
+	uint8_t *end;
+};
+
+static struct willneed_request willneed_queue[WILLNEED_QUEUE_SIZE];
+static size_t willneed_head, willneed_tail; /* Next to add, next to take. */
+static struct condition willneed_ready;     /* The queue is not empty. */
+static long long willneed_submit_cnt;       /* Requests queued. */
+static long long willneed_drop_cnt;         /* Requests dropped. */
+static long long willneed_page_cnt;         /* Pages read in. */
+
+static void willneed_daemon (void *aux);
+
+/* Fault counts and latency in TSC cycles, including any wait for
+ * vm_lock or the disk, by class.  Updated with interrupts off. */
+static struct faultstat fault_stat;
+
+static const char *fault_class_names[FAULT_CLASS_CNT] = {
+	"stack", "exec", "zero-fill", "swap-in", "file", "cow", "wp", "failed",
+};
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -15,7 +119,113 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	list_init (&frame_table);
+	clock_hand = NULL;
+	scan_hand = NULL;
+	lock_init (&vm_lock);
+	cond_init (&willneed_ready);
+	if (thread_create ("willneed", PRI_DEFAULT, willneed_daemon, NULL)
+			== TID_ERROR)
+		PANIC ("vm_init: cannot start willneed daemon");
+	text_init ();
+	zero_frame.kva = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	ksm_init ();
+	wss_init ();
+	kswapd_init ();
+}
+
+/* Returns the number of faults of every class that took [2**B,
+ * 2**(B+1)) cycles. */
+static long long
+latency_bucket (int b) {
+	long long cnt = 0;
+	int c;
+
+	for (c = 0; c < FAULT_CLASS_CNT; c++)
+		cnt += fault_stat.cycles[c][b];
+	return cnt;
+}
+
+/* Returns the number of cycles below which P percent of the faults
+ * recorded in fault_stat took, rounded up to a power of 2. */
+static unsigned long long
+latency_percentile (int p) {
+	long long total = 0, sum = 0;
+	int b;
+
+	for (b = 0; b < FAULT_HIST_BUCKETS; b++)
+		total += latency_bucket (b);
+	for (b = 0; b < FAULT_HIST_BUCKETS - 1; b++) {
+		sum += latency_bucket (b);
+		if (sum * 100 >= total * p)
+			break;
+	}
+	return total == 0 ? 0 : 2ULL << b;
+}
+
+/* Prints how many faults of each class were handled and how long they
+ * took, as the non-empty buckets of their histograms. */
+static void
+fault_print_stats (void) {
+	int c, b;
+
+	for (c = 0; c < FAULT_CLASS_CNT; c++) {
+		printf ("Faults (%s): %lld, cycles", fault_class_names[c],
+				fault_stat.count[c]);
+		for (b = 0; b < FAULT_HIST_BUCKETS; b++)
+			if (fault_stat.cycles[c][b] != 0)
+				printf (" 2^%d:%lld", b, fault_stat.cycles[c][b]);
+		printf ("\n");
+	}
+}
+
+/* Copies the page fault statistics to ST. */
+void
+vm_get_fault_stat (struct faultstat *st) {
+	enum intr_level old_level = intr_disable ();
+
+	memcpy (st, &fault_stat, sizeof *st);
+	intr_set_level (old_level);
+}
+
+/* Prints virtual memory statistics. */
+void
+vm_print_stats (void) {
+	printf ("Page faults: %lld loads, %lld pages faulted around\n",
+			fault_cnt, around_cnt);
+	printf ("Copy-on-write: %lld pages shared, %lld copied, "
+			"%lld private file pages written\n",
+			cow_share_cnt, cow_copy_cnt, private_cnt);
+	printf ("Zero page: %lld read faults, %lld written, %lld frames saved\n",
+			zero_map_cnt, zero_copy_cnt, zero_map_cnt - zero_copy_cnt);
+	printf ("Huge pages: %lld mapped, %lld faults saved\n",
+			thp_map_cnt, thp_map_cnt * (LARGE_PGPAGES - 1));
+	printf ("Resident-set limit: %lld pages evicted by their own process\n",
+			rss_evict_cnt);
+	printf ("Willneed: %lld requests, %lld dropped, %lld pages read\n",
+			willneed_submit_cnt, willneed_drop_cnt, willneed_page_cnt);
+	printf ("Fault latency: p50 %llu, p90 %llu, p99 %llu cycles, "
+			"%lld direct evictions\n", latency_percentile (50),
+			latency_percentile (90), latency_percentile (99), direct_evict_cnt);
+	fault_print_stats ();
+	kswapd_print_stats ();
+	text_print_stats ();
+	ksm_print_stats ();
+	vm_file_print_stats ();
+	vm_anon_print_stats ();
+}
+
+/* Locks the frame table.  Must be held to load, evict or free a
+ * page's frame. */
+void
+vm_lock_acquire (void) {
+	lock_acquire (&vm_lock);
+}
+
+/* Unlocks the frame table. */
+void
+vm_lock_release (void) {
+	lock_release (&vm_lock);
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -33,9 +243,14 @@ page_get_type (struct page *page) {
 }
 
 /* Helpers */
-static struct frame *vm_get_victim (void);
+static struct frame *vm_get_victim (struct thread *owner);
 static bool vm_do_claim_page (struct page *page);
-static struct frame *vm_evict_frame (void);
+static bool vm_fill_page (struct page *page, struct frame *frame);
+static struct frame *vm_evict_frame (struct thread *owner);
+static struct frame *frame_alloc (void);
+static struct frame *frame_create (void *kva);
+static void frame_release (struct frame *frame);
+static bool vm_stack_growth (void *addr);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -50,94 +265,944 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		struct page *page;
+
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				goto err;
+		}
 
-		/* TODO: Insert the page into the spt. */
+		page = malloc (sizeof *page);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, upage, init, type, aux, initializer);
+		page->writable = writable;
+		page->owner = thread_current ();
+		page->advice = MADV_NORMAL;
+
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
 }
 
+/* Returns the leaf slot for VA in SPT.  If CREATE is true, missing
+ * interior nodes are allocated; otherwise, or if allocation fails,
+ * returns NULL when VA's node does not exist. */
+static struct page **
+spt_slot (struct supplemental_page_table *spt, const void *va, bool create) {
+	void **node;
+	int level;
+
+	if (spt->root == NULL) {
+		if (!create || (spt->root = palloc_get_page (PAL_ZERO)) == NULL)
+			return NULL;
+	}
+
+	node = spt->root;
+	for (level = 0; level < SPT_LEVELS - 1; level++) {
+		void **slot = &node[spt_index (va, level)];
+
+		if (*slot == NULL) {
+			if (!create || (*slot = palloc_get_page (PAL_ZERO)) == NULL)
+				return NULL;
+		}
+		node = *slot;
+	}
+	return (struct page **) &node[spt_index (va, level)];
+}
+
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page **slot;
 
-	return page;
+	if (is_kernel_vaddr (va))
+		return NULL;
+	slot = spt_slot (spt, pg_round_down (va), false);
+	return slot != NULL ? *slot : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	struct page **slot;
+
+	ASSERT (pg_ofs (page->va) == 0);
 
-	return succ;
+	if (is_kernel_vaddr (page->va))
+		return false;
+	slot = spt_slot (spt, page->va, true);
+	if (slot == NULL || *slot != NULL)
+		return false;
+	*slot = page;
+	return true;
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	struct page **slot = spt_slot (spt, page->va, false);
+
+	ASSERT (slot != NULL && *slot == page);
+	*slot = NULL;
 	vm_dealloc_page (page);
+}
+
+/* Visits the pages under NODE, a node at LEVEL whose first slot
+ * covers address BASE, that lie in [START, END). */
+static bool
+spt_walk_range (void **node, int level, uint64_t base,
+		uint64_t start, uint64_t end, spt_page_func *func, void *aux) {
+	size_t i = start > base ? (start - base) >> spt_shift[level] : 0;
+
+	for (; i < SPT_FANOUT; i++) {
+		uint64_t va = base + ((uint64_t) i << spt_shift[level]);
+
+		if (va >= end)
+			break;
+		if (node[i] == NULL)
+			continue;
+		if (level == SPT_LEVELS - 1) {
+			if (!func (node[i], aux))
+				return false;
+		} else if (!spt_walk_range (node[i], level + 1, va, start, end,
+					func, aux))
+			return false;
+	}
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Calls FUNC with AUX for every page in SPT whose address lies in
+ * [START, END), in ascending address order, skipping empty subtrees.
+ * Stops and returns false as soon as FUNC does.  FUNC may remove the
+ * page it is given from SPT, but no other page. */
+bool
+spt_for_each_range (struct supplemental_page_table *spt,
+		void *start, void *end, spt_page_func *func, void *aux) {
+	if (spt->root == NULL)
+		return true;
+	return spt_walk_range (spt->root, 0, 0, (uint64_t) start, (uint64_t) end,
+			func, aux);
+}
+
+/* Frees NODE, a node at LEVEL, and everything below it. */
+static void
+spt_free_node (void **node, int level) {
+	size_t i;
+
+	for (i = 0; i < SPT_FANOUT; i++) {
+		if (node[i] == NULL)
+			continue;
+		if (level == SPT_LEVELS - 1)
+			vm_dealloc_page (node[i]);
+		else
+			spt_free_node (node[i], level + 1);
+	}
+	palloc_free_page (node);
+}
+
+/* Returns the frame under *HAND, which sweeps the frame table
+ * circularly, and advances the hand.  The table must not be empty. */
 static struct frame *
-vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+hand_advance (struct list_elem **hand) {
+	struct frame *frame;
 
-	return victim;
+	if (*hand == NULL || *hand == list_end (&frame_table))
+		*hand = list_begin (&frame_table);
+	frame = list_entry (*hand, struct frame, elem);
+	*hand = list_next (*hand);
+	return frame;
+}
+
+/* Returns the frame after the one the last call returned, going round
+ * the frame table, or a null pointer if the table is empty.  For
+ * scanning every frame in turn.  Must hold vm_lock. */
+struct frame *
+vm_frame_scan (void) {
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+
+	if (list_empty (&frame_table))
+		return NULL;
+	return hand_advance (&scan_hand);
+}
+
+/* Calls FUNC with AUX for every frame in the frame table.  FUNC must
+ * not add or remove frames.  Must hold vm_lock. */
+void
+vm_for_each_frame (frame_func *func, void *aux) {
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+
+	for (e = list_begin (&frame_table); e != list_end (&frame_table);
+			e = list_next (e))
+		func (list_entry (e, struct frame, elem), aux);
+}
+
+/* Returns true if process T may not have more resident pages without
+ * giving up some of its own. */
+bool
+vm_rss_at_limit (const struct thread *t) {
+	return t->rss_limit != 0 && t->spt.rss >= t->rss_limit;
 }
 
-/* Evict one page and return the corresponding frame.
+/* Returns true if any page sharing FRAME has been accessed since the
+ * last call, and clears their accessed bits.  Accesses the working-set
+ * sampler has seen, and cleared, count as well. */
+static bool
+frame_clear_accessed (struct frame *frame) {
+	struct page *page = frame->page;
+	bool accessed = false;
+
+	do {
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4_is_accessed (pml4, page->va)) {
+			pml4_set_accessed (pml4, page->va, false);
+			accessed = true;
+		}
+		if (page->referenced) {
+			page->referenced = false;
+			accessed = true;
+		}
+		page = page->share_next;
+	} while (page != frame->page);
+	return accessed;
+}
+
+/* Moves FRAME under the clock hand with its accessed bits cleared, so
+ * that it is the next frame looked at for eviction. */
+static void
+frame_deactivate (struct frame *frame) {
+	struct list_elem *hand;
+
+	frame_clear_accessed (frame);
+	if (clock_hand == &frame->elem)
+		return;
+	if (scan_hand == &frame->elem)
+		scan_hand = list_next (scan_hand);
+	list_remove (&frame->elem);
+	hand = clock_hand != NULL && clock_hand != list_end (&frame_table)
+		? clock_hand : list_begin (&frame_table);
+	list_insert (hand, &frame->elem);
+	clock_hand = &frame->elem;
+}
+
+/* Under MADV_SEQUENTIAL, pages this far behind the last fault are not
+ * expected to be accessed again. */
+#define DROP_BEHIND FAULT_AROUND_MAX
+
+/* Deactivates the resident pages DROP_BEHIND to 2 * DROP_BEHIND pages
+ * below PAGE, which was just loaded under MADV_SEQUENTIAL, so that they
+ * are evicted before pages that may still be used.  Frames shared with
+ * other pages are left alone. */
+static void
+vm_drop_behind (struct page *page) {
+	int i;
+
+	for (i = DROP_BEHIND; i <= 2 * DROP_BEHIND; i++) {
+		void *va = (uint8_t *) page->va - (uintptr_t) i * PGSIZE;
+		struct page *behind = spt_find_page (&page->owner->spt, va);
+
+		if (behind != NULL && behind->advice == MADV_SEQUENTIAL
+				&& behind->frame != NULL && behind->frame != &zero_frame
+				&& behind->frame->ref_cnt == 1 && behind->frame->pin_cnt == 0)
+			frame_deactivate (behind->frame);
+	}
+}
+
+/* Get the struct frame, that will be evicted.
+ *
+ * CLOCK: a frame whose accessed bit is set gets a second chance; the
+ * bit is cleared and the hand moves on.  Writing a clean frame out
+ * costs nothing, so dirty frames are passed over as well, and the
+ * first one seen is only taken if two full sweeps find no clean,
+ * unreferenced frame.  Pinned frames are never chosen.
+ *
+ * If OWNER is not null, only frames that process OWNER alone maps are
+ * considered, and a null pointer is returned if there are none. */
+static struct frame *
+vm_get_victim (struct thread *owner) {
+	size_t sweep = 2 * list_size (&frame_table);
+	struct frame *dirty = NULL;
+
+	while (sweep-- > 0) {
+		struct frame *frame = hand_advance (&clock_hand);
+		struct page *page = frame->page;
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (frame->pin_cnt > 0)
+			continue;
+		if (owner != NULL && (frame->ref_cnt > 1 || page->owner != owner))
+			continue;
+		if (vm_evict_policy == EVICT_FIFO)
+			return frame;
+
+		if (frame_clear_accessed (frame))
+			continue;
+		if (!pml4_is_dirty (pml4, page->va))
+			return frame;
+		if (dirty == NULL)
+			dirty = frame;
+	}
+	return dirty;
+}
+
+/* Maps every page sharing FRAME again after vm_evict_frame() unmapped
+ * them and then could not write FRAME out.  pml4_clear_page() only
+ * cleared the present bits, so each PTE still holds its writable,
+ * accessed and dirty bits.  A page whose PTE went with a large page
+ * that could not be split is left to fault back in. */
+static void
+frame_remap (struct frame *frame) {
+	struct page *page = frame->page;
+
+	do {
+		uint64_t *pml4 = page->owner->pml4;
+		uint64_t *pte = pml4e_walk (pml4, (uint64_t) page->va, false);
+
+		if (pte != NULL) {
+			bool writable = is_writable (pte);
+			bool accessed = pml4_is_accessed (pml4, page->va);
+			bool dirty = pml4_is_dirty (pml4, page->va);
+
+			/* The page table page is there, so this cannot fail. */
+			if (!pml4_set_page (pml4, page->va, frame->kva, writable))
+				NOT_REACHED ();
+			pml4_set_accessed (pml4, page->va, accessed);
+			pml4_set_dirty (pml4, page->va, dirty);
+		}
+		page = page->share_next;
+	} while (page != frame->page);
+}
+
+/* Evict one page, of process OWNER if it is not null, and return the
+ * corresponding frame.
  * Return NULL on error.*/
 static struct frame *
-vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+vm_evict_frame (struct thread *owner) {
+	struct frame *victim = vm_get_victim (owner);
+	struct page *page, *p;
+
+	if (victim == NULL)
+		return NULL;
+	page = victim->page;
+
+	/* Unmap first, so the owners fault and wait on vm_lock instead of
+	 * modifying the page while it is written out.  The dirty bit
+	 * survives in the not-present PTE for swap_out() to look at. */
+	p = page;
+	do {
+		pml4_clear_page (p->owner->pml4, p->va);
+		p = p->share_next;
+	} while (p != page);
+	if (!swap_out (page)) {
+		frame_remap (victim);
+		return NULL;
+	}
+
+	/* Pages shared copy-on-write go on sharing the copy in swap. */
+	p = page;
+	do {
+		struct page *next = p->share_next;
+
+		p->frame = NULL;
+		p->owner->spt.rss--;
+		if (p != page && VM_TYPE (p->operations->type) == VM_ANON)
+			anon_share (p, page);
+		p = next;
+	} while (p != page);
 
-	return NULL;
+	text_forget (victim);
+	ksm_forget (victim);
+	victim->page = NULL;
+	victim->ref_cnt = 0;
+	return victim;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.
+ *
+ * The frame is for a page of process OWNER.  If OWNER is at its
+ * resident-set limit, one of its own pages is evicted instead, so that
+ * it does not push other processes' pages out.
+ *
+ * Free frames are left to kswapd to replenish; a page is evicted here
+ * only once they fall below the reserve (see kswapd.c), or when the
+ * reserve cannot be refilled because no page can be evicted. */
 static struct frame *
-vm_get_frame (void) {
+vm_get_frame (struct thread *owner) {
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+
+	if (vm_rss_at_limit (owner)) {
+		frame = vm_evict_frame (owner);
+		if (frame != NULL)
+			rss_evict_cnt++;
+	}
+	if (frame == NULL && kswapd_may_allocate (false))
+		frame = frame_alloc ();
+	if (frame == NULL) {
+		frame = vm_evict_frame (NULL);
+		if (frame != NULL)
+			direct_evict_cnt++;
+	}
+	if (frame == NULL) {
+		frame = frame_alloc ();
+		if (frame == NULL)
+			PANIC ("vm_get_frame: out of user memory and swap");
+	}
 
 	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
 	return frame;
 }
 
-/* Growing the stack. */
+/* Like vm_get_frame(), but returns a null pointer instead of evicting
+ * a page when free frames run low.  For speculative loads. */
+struct frame *
+vm_get_free_frame (void) {
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+
+	if (!kswapd_may_allocate (true))
+		return NULL;
+	return frame_alloc ();
+}
+
+/* Takes a frame from the user pool and enters it in the frame table.
+ * Returns a null pointer if the pool is empty. */
+static struct frame *
+frame_alloc (void) {
+	void *kva = palloc_get_page (PAL_USER);
+
+	return kva != NULL ? frame_create (kva) : NULL;
+}
+
+/* Enters the user pool page KVA in the frame table as a free frame. */
+static struct frame *
+frame_create (void *kva) {
+	struct frame *frame = malloc (sizeof *frame);
+
+	if (frame == NULL)
+		PANIC ("frame_create: out of kernel memory");
+	frame->kva = kva;
+	frame->page = NULL;
+	frame->ref_cnt = 0;
+	frame->pin_cnt = 0;
+	frame->text_slot = NULL;
+	frame->ksm_sum = 0;
+	frame->ksm_hashed = false;
+
+	/* Just behind the hand, so it is looked at last. */
+	if (clock_hand != NULL)
+		list_insert (clock_hand, &frame->elem);
+	else
+		list_push_back (&frame_table, &frame->elem);
+	return frame;
+}
+
+/* Returns how many pages a fault on PAGE may load around it: none if
+ * the user advised random access, as many as possible if sequential.
+ * None either if PAGE is loaded by the willneed daemon: its owner runs
+ * meanwhile, and fault-around maps pages before they are filled. */
+unsigned
+vm_fault_around_window (const struct page *page) {
+	if (page->owner != thread_current ())
+		return 0;
+	switch (page->advice) {
+		case MADV_RANDOM:
+			return 0;
+		case MADV_SEQUENTIAL:
+			return FAULT_AROUND_MAX;
+		default:
+			return vm_fault_around;
+	}
+}
+
+/* Returns true if PAGE belongs to a private file mapping and was not
+ * written yet.  Such a page is mapped read-only, even if writable, so
+ * that its first write makes it anonymous. */
+static bool
+page_is_private_file (const struct page *page) {
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_UNINIT:
+			return (page->uninit.type & VM_PRIVATE) != 0;
+		case VM_FILE:
+			return page->file.private;
+		default:
+			return false;
+	}
+}
+
+/* Fault-around.  Gives each of the CNT pages in PAGES, which belong to
+ * the running process and are not resident, a free frame, without
+ * evicting anything for them, and maps it.  Pages that are still
+ * uninitialized are transmuted as by their first fault, but their
+ * loaders are not run.  Returns how many pages, from the start of
+ * PAGES, are prepared; the caller must fill their frames before
+ * returning to the user.  Must hold vm_lock. */
+size_t
+vm_fault_around_prepare (struct page **pages, size_t cnt) {
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+
+	for (i = 0; i < cnt; i++) {
+		struct page *page = pages[i];
+		struct frame *frame;
+
+		ASSERT (page->owner == thread_current ());
+		ASSERT (page->frame == NULL);
+
+		if (vm_rss_at_limit (page->owner))
+			break;
+		frame = vm_get_free_frame ();
+		if (frame == NULL)
+			break;
+		vm_frame_link (frame, page);
+		if (!pml4_set_page (page->owner->pml4, page->va, frame->kva,
+					page->writable && !page_is_private_file (page))) {
+			vm_free_frame (page);
+			break;
+		}
+		if (VM_TYPE (page->operations->type) == VM_UNINIT)
+			uninit_transmute (page, frame->kva);
+	}
+	around_cnt += i;
+	return i;
+}
+
+/* Reads SIZE bytes at OFS in FILE into the CNT frames KVAS, filling
+ * them in order, with a single read if they can be mapped side by
+ * side.  Returns true if all SIZE bytes were read. */
+bool
+vm_read_frames (struct file *file, off_t ofs, void **kvas, size_t cnt,
+		size_t size) {
+	void *area;
+	size_t i;
+
+	ASSERT (size <= cnt * PGSIZE);
+
+	area = cnt > 1 ? vmap (kvas, cnt) : kvas[0];
+	if (area != NULL) {
+		bool success = file_read_at (file, area, size, ofs) == (off_t) size;
+
+		if (cnt > 1)
+			vunmap (area);
+		return success;
+	}
+	for (i = 0; i < cnt && size > 0; i++) {
+		size_t chunk = size < PGSIZE ? size : PGSIZE;
+
+		if (file_read_at (file, kvas[i], chunk, ofs) != (off_t) chunk)
+			return false;
+		ofs += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+/* Writes SIZE bytes from the CNT frames KVAS, taken in order, to FILE
+ * at OFS, with a single write if they can be mapped side by side.
+ * Returns true if all SIZE bytes were written. */
+bool
+vm_write_frames (struct file *file, off_t ofs, void **kvas, size_t cnt,
+		size_t size) {
+	void *area;
+	size_t i;
+
+	ASSERT (size <= cnt * PGSIZE);
+
+	area = cnt > 1 ? vmap (kvas, cnt) : kvas[0];
+	if (area != NULL) {
+		bool success = file_write_at (file, area, size, ofs) == (off_t) size;
+
+		if (cnt > 1)
+			vunmap (area);
+		return success;
+	}
+	for (i = 0; i < cnt && size > 0; i++) {
+		size_t chunk = size < PGSIZE ? size : PGSIZE;
+
+		if (file_write_at (file, kvas[i], chunk, ofs) != (off_t) chunk)
+			return false;
+		ofs += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+/* Makes FRAME hold PAGE, and only PAGE. */
+void
+vm_frame_link (struct frame *frame, struct page *page) {
+	frame->page = page;
+	frame->ref_cnt = 1;
+	page->frame = frame;
+	page->share_next = page;
+	page->ws_history = 0;
+	page->owner->spt.rss++;
+}
+
+/* Makes PAGE, which has no frame, share FRAME with the pages that
+ * already do.  The caller maps it. */
+void
+vm_frame_share (struct frame *frame, struct page *page) {
+	ASSERT (page->frame == NULL);
+
+	page->frame = frame;
+	page->share_next = frame->page->share_next;
+	frame->page->share_next = page;
+	frame->ref_cnt++;
+	page->ws_history = 0;
+	page->owner->spt.rss++;
+}
+
+/* Detaches PAGE from its frame, if it has one, unmapping it.  Once no
+ * page shares the frame any longer, it is returned to the user pool.
+ * Must hold vm_lock. */
+void
+vm_free_frame (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+
+	if (frame == NULL)
+		return;
+	if (page->owner->pml4 != NULL)
+		pml4_clear_page (page->owner->pml4, page->va);
+	page->frame = NULL;
+
+	if (frame == &zero_frame)
+		return;
+	page->owner->spt.rss--;
+	if (--frame->ref_cnt > 0) {
+		struct page *prev = page;
+
+		while (prev->share_next != page)
+			prev = prev->share_next;
+		prev->share_next = page->share_next;
+		if (frame->page == page)
+			frame->page = page->share_next;
+		return;
+	}
+	frame_release (frame);
+}
+
+/* Removes FRAME, which no page uses any longer, from the frame table
+ * and returns it to the user pool. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+frame_release (struct frame *frame) {
+	text_forget (frame);
+	ksm_forget (frame);
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	if (scan_hand == &frame->elem)
+		scan_hand = list_next (scan_hand);
+	list_remove (&frame->elem);
+	palloc_free_page (frame->kva);
+	free (frame);
+}
+
+/* Evicts a page and returns its frame to the user pool, for kswapd.
+ * Returns false if no page could be evicted.  Must hold vm_lock. */
+bool
+vm_reclaim_frame (void) {
+	struct frame *frame;
+
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+
+	frame = vm_evict_frame (NULL);
+	if (frame == NULL)
+		return false;
+	frame_release (frame);
+	return true;
+}
+
+/* Returns true if an access to ADDR with user stack pointer RSP looks
+ * like a stack access: ADDR is within STACK_LIMIT below USER_STACK and
+ * at most 8 bytes below RSP, as far as PUSH reaches. */
+bool
+vm_is_stack_access (void *addr, uintptr_t rsp) {
+	uintptr_t va = (uintptr_t) addr;
+
+	return va < USER_STACK && va >= USER_STACK - STACK_LIMIT
+		&& va + 8 >= rsp;
+}
+
+/* Growing the stack.  The new page is loaded like any other, by the
+ * caller. */
+static bool
+vm_stack_growth (void *addr) {
+	return vm_alloc_page (VM_ANON | VM_STACK, pg_round_down (addr), true);
+}
+
+/* Returns true if PAGE is an anonymous page that was never loaded and
+ * starts out zeroed, such as stack and BSS pages. */
+static bool
+page_is_zero_fill (struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_UNINIT
+		&& VM_TYPE (page->uninit.type) == VM_ANON
+		&& page->uninit.init == NULL;
+}
+
+/* Returns true if FRAME must be copied before a page may write it. */
+static bool
+frame_is_shared (struct frame *frame) {
+	return frame == &zero_frame || frame->ref_cnt > 1;
 }
 
-/* Handle the fault on write_protected page */
+/* Maps the zero frame read-only at PAGE, a zero-fill page that is not
+ * resident.  Must hold vm_lock. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_map_zero_page (struct page *page) {
+	ASSERT (page_is_zero_fill (page));
+	ASSERT (page->frame == NULL);
+
+	if (!pml4_set_page (page->owner->pml4, page->va, zero_frame.kva, false))
+		return false;
+	page->frame = &zero_frame;
+	zero_map_cnt++;
+	return true;
+}
+
+/* Returns true if the page of OWNER at VA is a zero-fill page that is
+ * not resident and may be mapped like WRITABLE. */
+static bool
+huge_page_fits (struct thread *owner, void *va, bool writable) {
+	struct page *page = spt_find_page (&owner->spt, va);
+
+	return page != NULL && page_is_zero_fill (page) && page->frame == NULL
+		&& page->writable == writable;
+}
+
+/* Maps the LARGE_PGSIZE aligned range around PAGE, a zero-fill page,
+ * with a large page, if every page in the range is a zero-fill page
+ * that is not resident and an aligned run of free frames is at hand.
+ * Returns false, having done nothing, otherwise.  Must hold vm_lock. */
+static bool
+vm_map_huge_page (struct page *page) {
+	struct thread *owner = page->owner;
+	uint8_t *base = (uint8_t *) ((uintptr_t) page->va & ~(LARGE_PGSIZE - 1));
+	uint8_t *kva;
+	size_t i;
+
+	if (!vm_thp || !page_is_zero_fill (page)
+			|| (owner->rss_limit != 0
+				&& owner->spt.rss + LARGE_PGPAGES > owner->rss_limit))
+		return false;
+	for (i = 0; i < LARGE_PGPAGES; i++)
+		if (!huge_page_fits (owner, base + i * PGSIZE, page->writable))
+			return false;
+	if (!kswapd_may_allocate_run (LARGE_PGPAGES)
+			|| (kva = palloc_get_aligned (PAL_USER, LARGE_PGPAGES)) == NULL)
+		return false;
+
+	/* uninit_transmute() zeroes each frame. */
+	for (i = 0; i < LARGE_PGPAGES; i++) {
+		struct page *p = spt_find_page (&owner->spt, base + i * PGSIZE);
+
+		vm_frame_link (frame_create (kva + i * PGSIZE), p);
+		uninit_transmute (p, p->frame->kva);
+	}
+	if (!pml4_set_large_page (owner->pml4, base, kva, page->writable)) {
+		for (i = 0; i < LARGE_PGPAGES; i++)
+			anon_discard (spt_find_page (&owner->spt, base + i * PGSIZE));
+		return false;
+	}
+	thp_map_cnt++;
+	return true;
+}
+
+/* Returns true if PAGE, which is resident, must be given a frame of its
+ * own before it is written. */
+static bool
+page_must_copy (struct page *page) {
+	return frame_is_shared (page->frame) || page_is_private_file (page);
+}
+
+/* Gives PAGE a frame of its own that it may write, copying the frame
+ * it shares with other pages, if any.  A page of a private file mapping
+ * becomes anonymous, so that it is swapped rather than written back.
+ * Must hold vm_lock. */
+static bool
+vm_unshare_page (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&vm_lock));
+
+	/* Still uninitialized: load it for real. */
+	if (frame == &zero_frame) {
+		vm_free_frame (page);
+		zero_copy_cnt++;
+		frame = NULL;
+	}
+
+	/* Evicted since the fault: it comes back private, unless it is
+	 * read from a file that other mappings share. */
+	if (frame == NULL) {
+		if (!vm_do_claim_page (page))
+			return false;
+		if (!page_is_private_file (page))
+			return true;
+		frame = page->frame;
+	}
+
+	if (frame->ref_cnt > 1) {
+		struct frame *copy;
+
+		/* Keep the original from being evicted to make room. */
+		frame->pin_cnt++;
+		copy = vm_get_frame (page->owner);
+		frame->pin_cnt--;
+
+		memcpy (copy->kva, frame->kva, PGSIZE);
+		vm_free_frame (page);
+		vm_frame_link (copy, page);
+		cow_copy_cnt++;
+	} else
+		pml4_clear_page (page->owner->pml4, page->va);
+
+	if (page_is_private_file (page)) {
+		/* Other mappings must not share what is written now. */
+		text_forget (page->frame);
+		anon_adopt (page);
+		private_cnt++;
+	}
+
+	if (!pml4_set_page (page->owner->pml4, page->va, page->frame->kva, true)) {
+		vm_free_frame (page);
+		return false;
+	}
+	return true;
+}
+
+/* Handle the fault on write_protected page.  Writable pages are only
+ * mapped read-only while they share a frame, the zero frame or one
+ * shared copy-on-write by fork, or while they are unwritten pages of a
+ * private file mapping, so the write is resolved by giving PAGE a
+ * private copy.  Stores the class of the fault in *CLASS. */
+static bool
+vm_handle_wp (struct page *page, enum fault_class *class) {
+	bool success;
+
+	vm_lock_acquire ();
+	if (page->frame == &zero_frame)
+		*class = FAULT_ZERO;
+	else if (page->frame == NULL || page_must_copy (page))
+		*class = FAULT_COW;
+	else
+		*class = FAULT_WP;
+	success = vm_unshare_page (page);
+	vm_lock_release ();
+	return success;
+}
+
+/* Returns the class of a fault on PAGE, which is not resident, not
+ * counting stack growth.  Must hold vm_lock. */
+static enum fault_class
+fault_classify (struct page *page) {
+	switch (VM_TYPE (page->operations->type)) {
+		case VM_UNINIT:
+			if (VM_TYPE (page->uninit.type) == VM_FILE)
+				return FAULT_FILE;
+			return page->uninit.init == NULL ? FAULT_ZERO : FAULT_EXEC;
+		case VM_FILE:
+			return FAULT_FILE;
+		default:
+			return FAULT_SWAP;
+	}
+}
+
+/* Handles a fault; see vm_try_handle_fault().  Stores the class of the
+ * fault in *CLASS if it is handled. */
+static bool
+vm_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present, enum fault_class *class) {
+	struct thread *curr = thread_current ();
+	struct supplemental_page_table *spt = &curr->spt;
+	struct page *page;
+	bool grown = false;
+	bool success;
+
+	if (addr == NULL || is_kernel_vaddr (addr))
+		return false;
+
+	page = spt_find_page (spt, addr);
+	if (page == NULL) {
+		/* In a system call F holds the kernel's rsp, so use the user
+		 * rsp saved at syscall entry instead. */
+		uintptr_t rsp = user ? f->rsp : curr->user_rsp;
+
+		if (!not_present || !vm_is_stack_access (addr, rsp)
+				|| !vm_stack_growth (addr))
+			return false;
+		page = spt_find_page (spt, addr);
+		grown = true;
+	}
+	if (write && !page->writable)
+		return false;
+	if (!not_present)
+		return vm_handle_wp (page, class);
+
+	vm_lock_acquire ();
+	*class = grown ? FAULT_STACK : fault_classify (page);
+	if (vm_map_huge_page (page)) {
+		success = true;
+		fault_cnt++;
+	} else if (!write && page_is_zero_fill (page))
+		success = vm_map_zero_page (page);
+	else if (page->frame != NULL && page->frame != &zero_frame) {
+		/* Resident, but unmapped along with the rest of a large page
+		 * that could not be split (see pml4_clear_page()). */
+		success = pml4_set_page (page->owner->pml4, page->va,
+				page->frame->kva, page->writable && !page_must_copy (page));
+		if (success && write && page_must_copy (page))
+			success = vm_unshare_page (page);
+	} else {
+		success = vm_do_claim_page (page);
+		if (success && write && page_must_copy (page))
+			success = vm_unshare_page (page);
+		fault_cnt++;
+	}
+	if (success && page->advice == MADV_SEQUENTIAL)
+		vm_drop_behind (page);
+	vm_lock_release ();
+	return success;
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	uint64_t start = rdtsc ();
+	enum fault_class class;
+	bool success = vm_handle_fault (f, addr, user, write, not_present,
+			&class);
+	uint64_t cycles = rdtsc () - start;
+	enum intr_level old_level;
+	int b = 0;
 
-	return vm_do_claim_page (page);
+	if (!success)
+		class = FAULT_FAILED;
+	while (cycles >>= 1)
+		b++;
+	old_level = intr_disable ();
+	fault_stat.count[class]++;
+	fault_stat.cycles[class][b]++;
+	intr_set_level (old_level);
+	return success;
 }
 
 /* Free the page.
@@ -150,41 +1215,383 @@ vm_dealloc_page (struct page *page) {
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
+	bool success;
 
-	return vm_do_claim_page (page);
+	if (page == NULL)
+		return false;
+	vm_lock_acquire ();
+	success = vm_do_claim_page (page);
+	vm_lock_release ();
+	return success;
 }
 
-/* Claim the PAGE and set up the mmu. */
+/* Claim the PAGE and set up the mmu.  Must hold vm_lock. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	if (page->frame == &zero_frame)
+		vm_free_frame (page);
+	return vm_fill_page (page, vm_get_frame (page->owner));
+}
 
+/* Loads PAGE, which is not resident, into FRAME and maps it.  Must hold
+ * vm_lock. */
+static bool
+vm_fill_page (struct page *page, struct frame *frame) {
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	vm_frame_link (frame, page);
+
+	/* Fill the frame before mapping it, so the user never sees a
+	 * partially loaded page.  A loader may have traded the frame for a
+	 * shared one that holds the same contents already. */
+	if (!swap_in (page, frame->kva)
+			|| !pml4_set_page (page->owner->pml4, page->va, page->frame->kva,
+				page->writable && !page_is_private_file (page))) {
+		vm_free_frame (page);
+		return false;
+	}
+	return true;
+}
+
+/* Loads PAGE if it is not resident and pins its frame.  If WRITE is
+ * true and the frame is shared, PAGE gets a copy first, since the
+ * kernel's writes do not fault on read-only mappings. */
+static bool
+pin_page (struct page *page, bool write) {
+	bool success = true;
+
+	vm_lock_acquire ();
+	if (page->frame == NULL)
+		success = vm_do_claim_page (page);
+	if (success && write && page_must_copy (page))
+		success = vm_unshare_page (page);
+	if (success)
+		page->frame->pin_cnt++;
+	vm_lock_release ();
+	return success;
+}
+
+/* Loads PAGE if it is not resident and pins its frame, so that it
+ * stays resident until vm_unpin_page(). */
+bool
+vm_pin_page (struct page *page) {
+	return pin_page (page, false);
+}
+
+/* Makes PAGE's frame evictable again. */
+void
+vm_unpin_page (struct page *page) {
+	vm_lock_acquire ();
+	if (page->frame != NULL && page->frame->pin_cnt > 0)
+		page->frame->pin_cnt--;
+	vm_lock_release ();
+}
+
+/* Unpins the pages of the running process in [START, END). */
+static void
+unpin_pages (uint8_t *start, uint8_t *end) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	for (; start < end; start += PGSIZE) {
+		struct page *page = spt_find_page (spt, start);
+		if (page != NULL)
+			vm_unpin_page (page);
+	}
+}
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+/* Loads and pins every page of the user buffer [BUFFER, BUFFER +
+ * SIZE), growing the stack if needed, so that a system call can use
+ * the buffer without faulting or racing with eviction.  Returns false,
+ * with nothing left pinned, if part of the buffer is unmapped, or is
+ * read-only and WRITE is true. */
+bool
+vm_pin_buffer (void *buffer, size_t size, bool write) {
+	struct thread *curr = thread_current ();
+	uint8_t *start = pg_round_down (buffer);
+	uint8_t *end = (uint8_t *) buffer + size;
+	uint8_t *upage;
+
+	for (upage = start; upage < end; upage += PGSIZE) {
+		void *addr = upage < (uint8_t *) buffer ? buffer : upage;
+		struct page *page = spt_find_page (&curr->spt, upage);
+
+		if (page == NULL && vm_is_stack_access (addr, curr->user_rsp)
+				&& vm_stack_growth (addr))
+			page = spt_find_page (&curr->spt, upage);
+		if (page == NULL || (write && !page->writable)
+				|| !pin_page (page, write)) {
+			unpin_pages (start, upage);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Undoes vm_pin_buffer(). */
+void
+vm_unpin_buffer (void *buffer, size_t size) {
+	unpin_pages (pg_round_down (buffer), (uint8_t *) buffer + size);
+}
+
+/* spt_for_each_range() callback that loads PAGE if it is not resident.
+ * Stops at the first page that cannot be loaded. */
+static bool
+populate_page (struct page *page, void *aux UNUSED) {
+	bool success = true;
 
-	return swap_in (page, frame->kva);
+	vm_lock_acquire ();
+	if (page->frame == NULL)
+		success = vm_do_claim_page (page);
+	vm_lock_release ();
+	return success;
+}
+
+/* Loads the pages of the running process in [ADDR, ADDR + LENGTH) that
+ * are not resident, evicting other pages if need be, so that accessing
+ * them does not fault.  Pages that cannot be loaded are left for their
+ * first fault. */
+void
+vm_populate (void *addr, size_t length) {
+	spt_for_each_range (&thread_current ()->spt, addr,
+			(uint8_t *) addr + length, populate_page, NULL);
+}
+
+/* spt_for_each_range() callback for the willneed daemon: reads PAGE in
+ * if it is not resident and has contents to read, into a free frame,
+ * and stops so that vm_lock is released after each read.  Advances
+ * REQ_ past PAGE, or to its end once free frames run low or the owner
+ * is at its limit; nothing is evicted for a hint. */
+static bool
+willneed_page (struct page *page, void *req_) {
+	struct willneed_request *req = req_;
+	struct frame *frame;
+
+	req->addr = (uint8_t *) page->va + PGSIZE;
+	if (page->frame != NULL || page_is_zero_fill (page))
+		return true;
+
+	frame = NULL;
+	if (!vm_rss_at_limit (page->owner))
+		frame = vm_get_free_frame ();
+	if (frame == NULL)
+		req->addr = req->end;
+	else if (vm_fill_page (page, frame))
+		willneed_page_cnt++;
+	return false;
+}
+
+/* The willneed daemon.  Reads in the ranges queued by MADV_WILLNEED, in
+ * order, a page per hold of vm_lock so that faults are not held up. */
+static void
+willneed_daemon (void *aux UNUSED) {
+	vm_lock_acquire ();
+	for (;;) {
+		struct willneed_request *req;
+
+		while (willneed_head == willneed_tail)
+			cond_wait (&willneed_ready, &vm_lock);
+		req = &willneed_queue[willneed_tail % WILLNEED_QUEUE_SIZE];
+		if (req->owner == NULL
+				|| spt_for_each_range (&req->owner->spt, req->addr, req->end,
+					willneed_page, req))
+			willneed_tail++;
+
+		vm_lock_release ();
+		thread_yield ();
+		vm_lock_acquire ();
+	}
+}
+
+/* Queues [ADDR, END) of the running process for the willneed daemon.
+ * Dropped if the queue is full. */
+static void
+willneed_submit (void *addr, void *end) {
+	vm_lock_acquire ();
+	if (willneed_head - willneed_tail < WILLNEED_QUEUE_SIZE) {
+		willneed_queue[willneed_head++ % WILLNEED_QUEUE_SIZE] =
+			(struct willneed_request) {
+				.owner = thread_current (),
+				.addr = addr,
+				.end = end,
+			};
+		willneed_submit_cnt++;
+		cond_signal (&willneed_ready, &vm_lock);
+	} else
+		willneed_drop_cnt++;
+	vm_lock_release ();
+}
+
+/* Cancels the MADV_WILLNEED requests of OWNER, which is about to give up
+ * its address space or executable.  The daemon holds vm_lock while it
+ * reads a page in, so none of OWNER's is being read on return. */
+void
+vm_willneed_cancel (struct thread *owner) {
+	size_t i;
+
+	vm_lock_acquire ();
+	for (i = willneed_tail; i != willneed_head; i++) {
+		struct willneed_request *req =
+			&willneed_queue[i % WILLNEED_QUEUE_SIZE];
+
+		if (req->owner == owner)
+			req->owner = NULL;
+	}
+	vm_lock_release ();
+}
+
+/* spt_for_each_range() callback for MADV_DONTNEED: drops PAGE's frame.
+ * Writable anonymous pages lose their contents and read back as zeros;
+ * read-only ones, loaded from the executable, are kept.  Mapped pages
+ * are written back first, if modified, and read back from their file;
+ * written pages of private mappings read back from the file as well. */
+static bool
+dontneed_page (struct page *page, void *aux UNUSED) {
+	vm_lock_acquire ();
+	if (page->frame == NULL || page->frame->pin_cnt == 0) {
+		switch (VM_TYPE (page->operations->type)) {
+			case VM_ANON:
+				if (!file_private_discard (page) && page->writable)
+					anon_discard (page);
+				break;
+			case VM_FILE:
+				if (page->frame != NULL && swap_out (page))
+					vm_free_frame (page);
+				break;
+			default:
+				/* Not loaded yet; at most mapped to the zero frame. */
+				vm_free_frame (page);
+				break;
+		}
+	}
+	vm_lock_release ();
+	return true;
+}
+
+/* spt_for_each_range() callback that records access pattern ADVICE
+ * for PAGE. */
+static bool
+advise_page (struct page *page, void *advice) {
+	page->advice = *(int *) advice;
+	return true;
+}
+
+/* Applies ADVICE, one of the MADV_* values, to the pages of the running
+ * process in [ADDR, ADDR + LENGTH).  Unmapped pages in the range are
+ * skipped.  Returns false if ADDR is not page-aligned, the range is not
+ * in user space or ADVICE is unknown. */
+bool
+do_madvise (void *addr, size_t length, int advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *end = (uint8_t *) addr + length;
+
+	if (pg_ofs (addr) != 0 || end < (uint8_t *) addr
+			|| !is_user_vaddr (addr) || (length > 0 && !is_user_vaddr (end - 1)))
+		return false;
+
+	switch (advice) {
+		case MADV_NORMAL:
+		case MADV_RANDOM:
+		case MADV_SEQUENTIAL:
+			spt_for_each_range (spt, addr, end, advise_page, &advice);
+			return true;
+		case MADV_WILLNEED:
+			willneed_submit (addr, end);
+			return true;
+		case MADV_DONTNEED:
+			spt_for_each_range (spt, addr, end, dontneed_page, NULL);
+			return true;
+		default:
+			return false;
+	}
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	spt->root = NULL;
+	list_init (&spt->mmaps);
+	spt->rss = 0;
+}
+
+/* Gives the child table DST, which belongs to the running thread, a
+ * copy-on-write copy of anonymous page SRC.  A resident SRC shares its
+ * frame with the copy, mapped read-only in both processes until one of
+ * them writes to it; a swapped-out SRC shares its swap slot.  Pages of
+ * the executable that the parent never touched get a lazy copy of
+ * their own.  Must hold vm_lock. */
+static bool
+copy_anon_page (struct page *src, void *dst_) {
+	struct supplemental_page_table *dst = dst_;
+	struct thread *curr = thread_current ();
+	struct frame *frame;
+	struct page *page;
+
+	/* File-backed pages are copied along with their mapping. */
+	if (page_get_type (src) != VM_ANON)
+		return true;
+	/* Nothing to share until the parent writes to it. */
+	if (page_is_zero_fill (src))
+		return vm_alloc_page (src->uninit.type, src->va, src->writable);
+	if (VM_TYPE (src->operations->type) == VM_UNINIT)
+		return process_copy_lazy_page (src);
+
+	page = malloc (sizeof *page);
+	if (page == NULL)
+		return false;
+	*page = *src;
+	page->owner = curr;
+	page->frame = NULL;
+	page->anon.slot = SWAP_SLOT_NONE;
+	if (!spt_insert_page (dst, page)) {
+		free (page);
+		return false;
+	}
+	anon_share (page, src);
+
+	frame = src->frame;
+	if (frame != NULL) {
+		vm_frame_share (frame, page);
+		cow_share_cnt++;
+
+		if (!pml4_set_page (curr->pml4, page->va, frame->kva, false))
+			return false;
+		/* Not current, so no TLB entry to flush.  Splitting a large
+		 * page for the PTE may run out of memory; the fork fails then,
+		 * and the child's teardown drops its share of FRAME. */
+		ASSERT (src->owner != curr);
+		if (src->writable
+				&& !pml4_set_page (src->owner->pml4, src->va, frame->kva,
+					false))
+			return false;
+	}
+	return true;
 }
 
 /* Copy supplemental page table from src to dst */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	bool success;
+
+	vm_lock_acquire ();
+	success = spt_for_each_range (src, NULL, (void *) KERN_BASE,
+			copy_anon_page, dst);
+	vm_lock_release ();
+	return success && do_mmap_copy (dst, src);
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	vm_willneed_cancel (thread_current ());
+	/* Unmapping writes modified file pages back. */
+	do_munmap_all (spt);
+
+	if (spt->root != NULL) {
+		vm_lock_acquire ();
+		spt_free_node (spt->root, 0);
+		vm_lock_release ();
+		spt->root = NULL;
+	}
 }
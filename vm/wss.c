@@ -0,0 +1,96 @@
+/* wss.c: Working-set estimation.
+ *
+ * Every WS_INTERVAL ticks a kernel thread samples the accessed bit of
+ * every resident page, clearing it, and shifts it into the page's
+ * access history.  A process's working set is estimated as the number
+ * of its resident pages that were accessed in any of the last
+ * WS_SAMPLES samples, a sliding window of WS_SAMPLES * WS_INTERVAL
+ * ticks.
+ *
+ * Clearing accessed bits would hide accesses from the CLOCK eviction
+ * policy, so a sampled access also sets the page's referenced flag,
+ * which CLOCK treats like the accessed bit.  Everything here is
+ * protected by vm_lock. */
+
+#include "vm/wss.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include "vm/vm.h"
+
+/* Ticks between samples. */
+#define WS_INTERVAL (TIMER_FREQ / 4)
+
+/* Samples in the window, at most the bits in page->ws_history. */
+#define WS_SAMPLES 8
+#define WS_MASK ((1u << WS_SAMPLES) - 1)
+
+static void wss_daemon (void *aux);
+
+/* Starts the sampler. */
+void
+wss_init (void) {
+	if (thread_create ("wss", PRI_DEFAULT, wss_daemon, NULL) == TID_ERROR)
+		PANIC ("wss_init: cannot start sampler");
+}
+
+/* Samples the accessed bits of the pages sharing FRAME. */
+static void
+sample_frame (struct frame *frame, void *aux UNUSED) {
+	struct page *page = frame->page;
+
+	do {
+		uint64_t *pml4 = page->owner->pml4;
+		bool accessed = pml4_is_accessed (pml4, page->va);
+
+		if (accessed) {
+			pml4_set_accessed (pml4, page->va, false);
+			page->referenced = true;
+		}
+		page->ws_history = (page->ws_history << 1) | accessed;
+		page = page->share_next;
+	} while (page != frame->page);
+}
+
+/* Takes a sample every WS_INTERVAL ticks.  Running on the kernel-only
+ * page table, it needs no TLB flush for the accessed bits it clears. */
+static void
+wss_daemon (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (WS_INTERVAL);
+		vm_lock_acquire ();
+		vm_for_each_frame (sample_frame, NULL);
+		vm_lock_release ();
+	}
+}
+
+struct wss_count {
+	struct thread *owner;       /* Process whose pages to count. */
+	size_t cnt;                 /* Pages counted so far. */
+};
+
+/* Counts the pages of AUX's process that share FRAME and were accessed
+ * within the window. */
+static void
+count_frame (struct frame *frame, void *aux) {
+	struct wss_count *wc = aux;
+	struct page *page = frame->page;
+
+	do {
+		if (page->owner == wc->owner && (page->ws_history & WS_MASK) != 0)
+			wc->cnt++;
+		page = page->share_next;
+	} while (page != frame->page);
+}
+
+/* Returns the estimated working-set size of process T, in pages. */
+size_t
+wss_estimate (struct thread *t) {
+	struct wss_count wc = { .owner = t, .cnt = 0 };
+
+	vm_lock_acquire ();
+	vm_for_each_frame (count_frame, &wc);
+	vm_lock_release ();
+	return wc.cnt;
+}
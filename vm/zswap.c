@@ -0,0 +1,372 @@
+/* zswap.c: Compressed cache in front of the swap disk.
+ *
+ * Every page written to a swap slot is first offered to this cache,
+ * which compresses it and keeps it in a pool of kernel memory instead
+ * of writing it to disk.  Reading the slot back decompresses it, again
+ * without disk I/O.  Pages that do not shrink to ZSWAP_MAX_LEN bytes
+ * are refused and go to disk directly.  When the pool is full, the
+ * least recently used pages in it are written to their slots on disk
+ * to make room.
+ *
+ * The pool is zswap_pool_pages pages from the kernel pool, mapped side
+ * by side by vmalloc() and carved into ZSWAP_CHUNK-byte chunks.  A
+ * compressed page takes a run of consecutive chunks, found first-fit.
+ *
+ * The cache is keyed by slot, so slots shared by several pages need no
+ * special care: the entry goes when the slot is freed or rewritten. */
+
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+
+/* A swap slot holds one page. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Pool allocation unit. */
+#define ZSWAP_CHUNK 64
+
+/* Largest compressed page worth keeping. */
+#define ZSWAP_MAX_LEN (PGSIZE * 3 / 4)
+
+/* A compressed page. */
+struct zswap_entry {
+	struct hash_elem elem;      /* Element in entries. */
+	struct list_elem lru_elem;  /* Element in lru, most recent first. */
+	size_t slot;                /* Swap slot it stands for. */
+	size_t chunk;               /* First chunk it occupies. */
+	size_t len;                 /* Compressed length in bytes. */
+};
+
+size_t zswap_pool_pages = 128;
+
+static struct disk *swap_disk;
+static uint8_t *pool;               /* Chunks, or NULL if disabled. */
+static struct bitmap *pool_map;     /* Chunks in use. */
+static struct hash entries;         /* Entries by slot. */
+static struct list lru;             /* Entries, most recently used first. */
+static struct lock zswap_lock;      /* Protects all of the above. */
+
+static uint8_t *zbuf;               /* Page to compress into. */
+static uint8_t *bounce;             /* Page to write back from. */
+
+/* Statistics.  Protected by zswap_lock. */
+static long long store_cnt;         /* Pages stored. */
+static long long store_bytes;       /* Their compressed size. */
+static long long reject_cnt;        /* Pages refused as incompressible. */
+static long long load_cnt;          /* Pages loaded. */
+static long long writeback_cnt;     /* Pages written back to disk. */
+
+/* LZ77 compression.
+ *
+ * The compressed stream is a sequence of items, each starting with a
+ * token byte T.  If T < 0x80, T + 1 literal bytes follow.  Otherwise
+ * the item is a copy of (T & 0x7f) + LZ_MIN_MATCH bytes from a 16-bit
+ * little-endian distance back in the output, which follows T.  Matches
+ * are found through a hash table of the last position at which each
+ * 4-byte sequence hashed to a bucket. */
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)
+#define LZ_MAX_LITERALS 0x80
+#define LZ_HASH_BITS 12
+#define LZ_NONE UINT16_MAX
+
+/* Last position of each sequence.  Protected by zswap_lock. */
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+/* Returns the 4 bytes at P. */
+static inline uint32_t
+lz_load32 (const uint8_t *p) {
+	uint32_t v;
+
+	memcpy (&v, p, sizeof v);
+	return v;
+}
+
+/* Appends the CNT literal bytes at SRC to the output DST, which holds
+ * *OP of at most CAP bytes.  Returns false if they do not fit. */
+static bool
+lz_literals (uint8_t *dst, size_t *op, size_t cap, const uint8_t *src,
+		size_t cnt) {
+	while (cnt > 0) {
+		size_t n = cnt < LZ_MAX_LITERALS ? cnt : LZ_MAX_LITERALS;
+
+		if (*op + 1 + n > cap)
+			return false;
+		dst[(*op)++] = n - 1;
+		memcpy (dst + *op, src, n);
+		*op += n;
+		src += n;
+		cnt -= n;
+	}
+	return true;
+}
+
+/* Compresses the page at SRC into DST, which has room for CAP bytes.
+ * Returns the compressed length, or 0 if it would exceed CAP. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t cap) {
+	size_t ip = 0, op = 0, lit = 0;
+
+	memset (lz_table, 0xff, sizeof lz_table);
+	while (ip + LZ_MIN_MATCH <= PGSIZE) {
+		uint32_t seq = lz_load32 (src + ip);
+		size_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+		size_t ref = lz_table[h];
+		size_t len;
+
+		lz_table[h] = ip;
+		if (ref == LZ_NONE || lz_load32 (src + ref) != seq) {
+			ip++;
+			continue;
+		}
+
+		for (len = LZ_MIN_MATCH; ip + len < PGSIZE && len < LZ_MAX_MATCH
+				&& src[ref + len] == src[ip + len]; len++)
+			continue;
+		if (!lz_literals (dst, &op, cap, src + lit, ip - lit)
+				|| op + 3 > cap)
+			return 0;
+		dst[op++] = 0x80 | (len - LZ_MIN_MATCH);
+		dst[op++] = (ip - ref) & 0xff;
+		dst[op++] = (ip - ref) >> 8;
+		ip += len;
+		lit = ip;
+	}
+	if (!lz_literals (dst, &op, cap, src + lit, PGSIZE - lit))
+		return 0;
+	return op;
+}
+
+/* Decompresses the LEN bytes at SRC into the page DST.  Returns false
+ * if they do not make up exactly one page. */
+static bool
+lz_decompress (const uint8_t *src, size_t len, uint8_t *dst) {
+	size_t ip = 0, op = 0;
+
+	while (ip < len) {
+		uint8_t t = src[ip++];
+
+		if (t < 0x80) {
+			size_t n = t + 1;
+
+			if (ip + n > len || op + n > PGSIZE)
+				return false;
+			memcpy (dst + op, src + ip, n);
+			ip += n;
+			op += n;
+		} else {
+			size_t n = (t & 0x7f) + LZ_MIN_MATCH;
+			size_t dist;
+
+			if (ip + 2 > len)
+				return false;
+			dist = src[ip] | (src[ip + 1] << 8);
+			ip += 2;
+			if (dist == 0 || dist > op || op + n > PGSIZE)
+				return false;
+			/* Byte by byte: the copy may overlap its source. */
+			for (; n > 0; n--, op++)
+				dst[op] = dst[op - dist];
+		}
+	}
+	return op == PGSIZE;
+}
+
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+
+/* Sets up the cache for SWAP_DISK, if zswap_pool_pages is not 0. */
+void
+zswap_init (struct disk *disk) {
+	swap_disk = disk;
+	lock_init (&zswap_lock);
+	list_init (&lru);
+	if (disk == NULL || zswap_pool_pages == 0)
+		return;
+
+	pool = vmalloc (zswap_pool_pages * PGSIZE);
+	pool_map = bitmap_create (zswap_pool_pages * PGSIZE / ZSWAP_CHUNK);
+	zbuf = palloc_get_page (0);
+	bounce = palloc_get_page (0);
+	if (pool == NULL || pool_map == NULL || zbuf == NULL || bounce == NULL
+			|| !hash_init (&entries, entry_hash, entry_less, NULL)) {
+		printf ("zswap: cannot allocate %zu page pool, disabled\n",
+				zswap_pool_pages);
+		vfree (pool);
+		if (pool_map != NULL)
+			bitmap_destroy (pool_map);
+		palloc_free_page (zbuf);
+		palloc_free_page (bounce);
+		pool = NULL;
+	}
+}
+
+/* Prints compressed cache statistics. */
+void
+zswap_print_stats (void) {
+	printf ("Zswap: %lld pages stored, compressed to %lld%%, "
+			"%lld incompressible, %lld written back; "
+			"%lld disk writes and %lld reads avoided\n",
+			store_cnt, store_cnt ? store_bytes * 100 / (store_cnt * PGSIZE) : 0,
+			reject_cnt, writeback_cnt, store_cnt - writeback_cnt, load_cnt);
+}
+
+/* Returns the hash of entry E, its slot. */
+static uint64_t
+entry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_bytes (&hash_entry (e, struct zswap_entry, elem)->slot,
+			sizeof (size_t));
+}
+
+/* Orders entries A and B by slot. */
+static bool
+entry_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct zswap_entry, elem)->slot
+		< hash_entry (b, struct zswap_entry, elem)->slot;
+}
+
+/* Returns the entry for SLOT, or a null pointer.  Must hold
+ * zswap_lock. */
+static struct zswap_entry *
+entry_find (size_t slot) {
+	struct zswap_entry key;
+	struct hash_elem *e;
+
+	key.slot = slot;
+	e = hash_find (&entries, &key.elem);
+	return e != NULL ? hash_entry (e, struct zswap_entry, elem) : NULL;
+}
+
+/* Removes ENTRY and frees its chunks.  Must hold zswap_lock. */
+static void
+entry_free (struct zswap_entry *entry) {
+	hash_delete (&entries, &entry->elem);
+	list_remove (&entry->lru_elem);
+	bitmap_set_multiple (pool_map, entry->chunk,
+			DIV_ROUND_UP (entry->len, ZSWAP_CHUNK), false);
+	free (entry);
+}
+
+/* Writes the least recently used page back to its slot on disk and
+ * drops it.  Returns false if the cache is empty.  Must hold
+ * zswap_lock. */
+static bool
+writeback_lru (void) {
+	struct zswap_entry *entry;
+
+	if (list_empty (&lru))
+		return false;
+	entry = list_entry (list_back (&lru), struct zswap_entry, lru_elem);
+	if (!lz_decompress (pool + entry->chunk * ZSWAP_CHUNK, entry->len, bounce))
+		PANIC ("zswap: slot %zu is corrupt", entry->slot);
+	disk_write_multiple (swap_disk, entry->slot * SECTORS_PER_SLOT, bounce,
+			SECTORS_PER_SLOT);
+	writeback_cnt++;
+	entry_free (entry);
+	return true;
+}
+
+/* Stores the page at KVA as the contents of SLOT.  Returns true if it
+ * was, or false if the caller must write it to disk itself: the cache
+ * is disabled or the page is incompressible.  Either way any contents
+ * cached for SLOT before are dropped. */
+bool
+zswap_store (size_t slot, const void *kva) {
+	struct zswap_entry *entry;
+	size_t len, chunk_cnt, chunk;
+
+	if (pool == NULL)
+		return false;
+
+	lock_acquire (&zswap_lock);
+	entry = entry_find (slot);
+	if (entry != NULL)
+		entry_free (entry);
+
+	len = lz_compress (kva, zbuf, ZSWAP_MAX_LEN);
+	if (len == 0) {
+		reject_cnt++;
+		lock_release (&zswap_lock);
+		return false;
+	}
+	entry = malloc (sizeof *entry);
+	if (entry == NULL) {
+		lock_release (&zswap_lock);
+		return false;
+	}
+
+	chunk_cnt = DIV_ROUND_UP (len, ZSWAP_CHUNK);
+	while ((chunk = bitmap_scan_and_flip (pool_map, 0, chunk_cnt, false))
+			== BITMAP_ERROR)
+		if (!writeback_lru ()) {
+			/* Too fragmented, or too small, even when empty. */
+			free (entry);
+			lock_release (&zswap_lock);
+			return false;
+		}
+
+	memcpy (pool + chunk * ZSWAP_CHUNK, zbuf, len);
+	entry->slot = slot;
+	entry->chunk = chunk;
+	entry->len = len;
+	hash_insert (&entries, &entry->elem);
+	list_push_front (&lru, &entry->lru_elem);
+	store_cnt++;
+	store_bytes += len;
+	lock_release (&zswap_lock);
+	return true;
+}
+
+/* Reads the contents of SLOT into the page at KVA if they are cached,
+ * and returns true, or returns false if they must be read from disk. */
+bool
+zswap_load (size_t slot, void *kva) {
+	struct zswap_entry *entry;
+
+	if (pool == NULL)
+		return false;
+
+	lock_acquire (&zswap_lock);
+	entry = entry_find (slot);
+	if (entry != NULL) {
+		if (!lz_decompress (pool + entry->chunk * ZSWAP_CHUNK, entry->len, kva))
+			PANIC ("zswap: slot %zu is corrupt", slot);
+		/* The slot stays in use while the page is resident and clean, so
+		 * the copy stays, but it is now the least likely to be needed:
+		 * write it back first. */
+		list_remove (&entry->lru_elem);
+		list_push_back (&lru, &entry->lru_elem);
+		load_cnt++;
+	}
+	lock_release (&zswap_lock);
+	return entry != NULL;
+}
+
+/* Drops the contents cached for SLOT, which is being freed. */
+void
+zswap_invalidate (size_t slot) {
+	struct zswap_entry *entry;
+
+	if (pool == NULL)
+		return;
+
+	lock_acquire (&zswap_lock);
+	entry = entry_find (slot);
+	if (entry != NULL)
+		entry_free (entry);
+	lock_release (&zswap_lock);
+}